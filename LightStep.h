@@ -17,8 +17,14 @@ FOUNDATION_EXPORT const unsigned char LightStepVersionString[];
 // In this header, you should import all the public headers of your framework using statements like #import <LightStep/PublicHeader.h>
 
 #import <LightStep/LSClockState.h>
+#import <LightStep/LSHTTPTransport.h>
+#import <LightStep/LSScope.h>
 #import <LightStep/LSSpan.h>
 #import <LightStep/LSSpanContext.h>
+#import <LightStep/LSStringInterner.h>
+#import <LightStep/LSTraceAssembler.h>
 #import <LightStep/LSTracer.h>
+#import <LightStep/LSTransport.h>
+#import <LightStep/LSUnixSocketTransport.h>
 #import <LightStep/LSUtil.h>
 #import <LightStep/LSVersion.h>
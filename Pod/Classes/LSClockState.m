@@ -77,7 +77,8 @@ static void persistSamplesToUserDefaults(NSArray *samples) {
 }
 
 + (SInt64)nowMicros {
-    return (SInt64)([[NSDate date] timeIntervalSince1970] * USEC_PER_SEC);
+    // Equivalent to [[NSDate date] timeIntervalSince1970], without allocating an NSDate.
+    return (SInt64)((CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970) * USEC_PER_SEC);
 }
 
 - (SInt64)offsetMicros {
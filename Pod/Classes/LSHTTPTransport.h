@@ -0,0 +1,24 @@
+#import <Foundation/Foundation.h>
+
+#import "LSTransport.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Reports to a collector by HTTP POST of the JSON report. This is the `LSTracer` default.
+///
+/// LSHTTPTransport is thread-safe.
+@interface LSHTTPTransport : NSObject<LSTransport>
+
+/// @param url the URL for the collector's HTTP+JSON report endpoint
+- (instancetype)initWithURL:(NSURL *)url;
+
+/// The collector's report endpoint.
+@property(nonatomic, strong, readonly) NSURL *url;
+
+/// HTTP session to be used for performing requests. Defaults to a session with the default configuration, created
+/// on first use.
+@property(atomic, strong, null_resettable) NSURLSession *urlSession;
+
+@end
+
+NS_ASSUME_NONNULL_END
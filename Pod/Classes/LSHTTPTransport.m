@@ -0,0 +1,59 @@
+#import "LSHTTPTransport.h"
+
+@implementation LSHTTPTransport
+
+@synthesize urlSession = _urlSession;
+
+- (instancetype)initWithURL:(NSURL *)url {
+    if (self = [super init]) {
+        _url = url;
+    }
+    return self;
+}
+
+- (NSURLSession *)urlSession {
+    @synchronized(self) {
+        if (_urlSession == nil) {
+            _urlSession = [NSURLSession sessionWithConfiguration:
+                           [NSURLSessionConfiguration defaultSessionConfiguration]];
+        }
+        return _urlSession;
+    }
+}
+
+- (void)setUrlSession:(NSURLSession *)urlSession {
+    @synchronized(self) {
+        _urlSession = urlSession;
+    }
+}
+
+- (void)sendReport:(NSData *)report accessToken:(NSString *)accessToken completion:(LSTransportCompletion)completion {
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:self.url];
+    request.allHTTPHeaderFields = @{
+        @"Content-Type": @"application/json",
+        @"LightStep-Access-Token": accessToken
+    };
+    request.HTTPBody = report;
+    request.HTTPMethod = @"POST";
+
+    NSURLSessionDataTask *postDataTask =
+        [self.urlSession dataTaskWithRequest:request
+                           completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+            if (error != nil || data == nil) {
+                completion(false, nil, error);
+                return;
+            }
+            NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]]
+                ? ((NSHTTPURLResponse *)response).statusCode
+                : 200;
+            BOOL delivered = statusCode >= 200 && statusCode < 300;
+
+            NSError *jsonError;
+            id responseJSON = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:&jsonError];
+            completion(delivered, [responseJSON isKindOfClass:[NSDictionary class]] ? responseJSON : nil, jsonError);
+        }];
+    // "Start" (resume) the HTTP activity.
+    [postDataTask resume];
+}
+
+@end
@@ -0,0 +1,42 @@
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class LSSpan;
+
+/// An `LSScope` marks a span as the active span of the current thread until it is closed. While a span is active,
+/// `-[LSTracer startSpan:...]` calls that pass no parent make it the parent of the new span.
+///
+/// Scopes must be closed on the thread that created them, in the reverse order of activation.
+///
+/// @see -[LSTracer activateSpan:]
+@interface LSScope : NSObject
+
+/// Internal function.
+///
+/// Makes `span` active on the current thread. Use `-[LSTracer activateSpan:]` instead.
+- (instancetype)initWithSpan:(nullable LSSpan *)span;
+
+/// The span this scope activated.
+@property(nonatomic, strong, readonly, nullable) LSSpan *span;
+
+/// Restore whichever span was active when this scope was created. Closing a scope twice has no effect.
+- (void)close;
+
+@end
+
+/// @returns The span active on the current thread, or nil.
+FOUNDATION_EXPORT LSSpan *_Nullable LSActiveSpan(void);
+
+/// Like `dispatch_async`, but `block` runs with the caller's active span active, or with no active span if the caller
+/// has none. The added cost is at most one small allocation and two thread-local writes; when neither thread has an
+/// active span, it is a single thread-local read.
+FOUNDATION_EXPORT void LSDispatchAsync(dispatch_queue_t queue, dispatch_block_t block);
+
+/// Like `dispatch_after`, but `block` runs with the caller's active span active.
+FOUNDATION_EXPORT void LSDispatchAfter(dispatch_time_t when, dispatch_queue_t queue, dispatch_block_t block);
+
+/// Like `dispatch_group_async`, but `block` runs with the caller's active span active.
+FOUNDATION_EXPORT void LSDispatchGroupAsync(dispatch_group_t group, dispatch_queue_t queue, dispatch_block_t block);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,137 @@
+#import "LSScope.h"
+#import "LSSpan.h"
+#import <pthread.h>
+
+#pragma mark - Thread-local active span
+
+// The slot always owns a +1 reference to the span stored in it.
+static pthread_key_t LSActiveSpanKey;
+
+static void LSReleaseActiveSpan(void *span) {
+    CFRelease(span);
+}
+
+static pthread_key_t LSActiveSpanTLSKey(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&LSActiveSpanKey, LSReleaseActiveSpan);
+    });
+    return LSActiveSpanKey;
+}
+
+// Stores a +1 reference as the active span and hands back the previous one's +1 reference to the caller.
+static void *LSExchangeActiveSpan(void *retainedSpan) {
+    pthread_key_t key = LSActiveSpanTLSKey();
+    void *previous = pthread_getspecific(key);
+    pthread_setspecific(key, retainedSpan);
+    return previous;
+}
+
+LSSpan *LSActiveSpan(void) {
+    return (__bridge LSSpan *)pthread_getspecific(LSActiveSpanTLSKey());
+}
+
+#pragma mark - LSScope
+
+@interface LSScope ()
+@property(nonatomic, strong, nullable) LSSpan *previousSpan;
+@property(nonatomic) BOOL closed;
+@end
+
+@implementation LSScope
+
+- (instancetype)initWithSpan:(LSSpan *)span {
+    if (self = [super init]) {
+        _span = span;
+        _previousSpan = CFBridgingRelease(LSExchangeActiveSpan((void *)CFBridgingRetain(span)));
+    }
+    return self;
+}
+
+- (void)close {
+    if (self.closed) {
+        return;
+    }
+    self.closed = true;
+    void *current = LSExchangeActiveSpan((void *)CFBridgingRetain(self.previousSpan));
+    self.previousSpan = nil;
+    if (current != NULL) {
+        CFRelease(current);
+    }
+}
+
+@end
+
+#pragma mark - Dispatch wrappers
+
+// A plain C context passed to dispatch_*_f, so that propagating the span needs no wrapper block.
+typedef struct {
+    void *span;  // +1
+    void *block; // +1
+} LSActiveSpanContext;
+
+static void LSRunWithActiveSpan(void *context) {
+    LSActiveSpanContext *ctx = context;
+    void *previous = LSExchangeActiveSpan(ctx->span);
+    dispatch_block_t block = (__bridge_transfer dispatch_block_t)ctx->block;
+    free(ctx);
+    block();
+    void *current = LSExchangeActiveSpan(previous);
+    if (current != NULL) {
+        CFRelease(current);
+    }
+}
+
+// Runs the block with no active span, in case one was left active on this thread.
+static void LSRunWithNoActiveSpan(void *context) {
+    dispatch_block_t block = (__bridge_transfer dispatch_block_t)context;
+    if (pthread_getspecific(LSActiveSpanTLSKey()) == NULL) {
+        block();
+        return;
+    }
+    void *previous = LSExchangeActiveSpan(NULL);
+    block();
+    void *current = LSExchangeActiveSpan(previous);
+    if (current != NULL) {
+        CFRelease(current);
+    }
+}
+
+// Returns NULL when there is no active span to propagate.
+static LSActiveSpanContext *LSCaptureActiveSpan(dispatch_block_t block) {
+    void *span = pthread_getspecific(LSActiveSpanTLSKey());
+    if (span == NULL) {
+        return NULL;
+    }
+    LSActiveSpanContext *ctx = malloc(sizeof(LSActiveSpanContext));
+    ctx->span = (void *)CFRetain(span);
+    ctx->block = (__bridge_retained void *)[block copy];
+    return ctx;
+}
+
+void LSDispatchAsync(dispatch_queue_t queue, dispatch_block_t block) {
+    LSActiveSpanContext *ctx = LSCaptureActiveSpan(block);
+    if (ctx == NULL) {
+        dispatch_async_f(queue, (__bridge_retained void *)[block copy], LSRunWithNoActiveSpan);
+        return;
+    }
+    dispatch_async_f(queue, ctx, LSRunWithActiveSpan);
+}
+
+void LSDispatchAfter(dispatch_time_t when, dispatch_queue_t queue, dispatch_block_t block) {
+    LSActiveSpanContext *ctx = LSCaptureActiveSpan(block);
+    if (ctx == NULL) {
+        dispatch_after_f(when, queue, (__bridge_retained void *)[block copy], LSRunWithNoActiveSpan);
+        return;
+    }
+    dispatch_after_f(when, queue, ctx, LSRunWithActiveSpan);
+}
+
+void LSDispatchGroupAsync(dispatch_group_t group, dispatch_queue_t queue, dispatch_block_t block) {
+    LSActiveSpanContext *ctx = LSCaptureActiveSpan(block);
+    if (ctx == NULL) {
+        dispatch_group_async_f(group, queue, (__bridge_retained void *)[block copy], LSRunWithNoActiveSpan);
+        return;
+    }
+    dispatch_group_async_f(group, queue, ctx, LSRunWithActiveSpan);
+}
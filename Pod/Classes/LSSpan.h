@@ -19,6 +19,12 @@ NS_ASSUME_NONNULL_BEGIN
 /// Creates a new span associated with the given tracer.
 - (instancetype)initWithTracer:(LSTracer *)tracer;
 
+/// Internal function.
+///
+/// Creates a span that records nothing. A tracer hands out a single shared instance of it while disabled or when
+/// a trace is not sampled, so that instrumentation costs next to nothing.
+- (instancetype)initNonRecordingWithTracer:(LSTracer *)tracer;
+
 /// Internal function.
 ///
 /// Creates a new span associated with the given tracer and the other optional parameters.
@@ -30,6 +36,23 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property(nonatomic, strong) NSDictionary<NSString *, NSString *> *tags;
 
+/// The span's context, typed for use with `-[LSTracer startSpan:parentContext:]`.
+@property(atomic, strong, readonly) LSSpanContext *context;
+
+/// False for the shared span handed out by a disabled tracer or for an unsampled trace. Tags, logs, baggage and
+/// finishing are all ignored on such a span.
+@property(nonatomic, readonly, getter=isRecording) BOOL recording;
+
+/// Typed tag setters. The value is recorded exactly as if it had been boxed and passed in a tags dictionary.
+///
+/// They skip the tags dictionary and OTReference allocations of the OTSpan/OTTracer API, but the value itself is
+/// still stored as an NSNumber: tags live in a single dictionary that `tagForKey:` and the JSON encoder read. Boolean
+/// values are shared constants and most integers fit a tagged pointer, so neither allocates; large integers and
+/// most doubles do.
+- (void)setTag:(NSString *)key boolValue:(BOOL)value;
+- (void)setTag:(NSString *)key integerValue:(SInt64)value;
+- (void)setTag:(NSString *)key doubleValue:(double)value;
+
 ///  Get a particular tag.
 - (NSString *)tagForKey:(NSString *)key;
 
@@ -1,3 +1,4 @@
+#import "LSClockState.h"
 #import "LSSpan.h"
 #import "LSSpanContext.h"
 #import "LSTracer.h"
@@ -43,14 +44,32 @@
 @property(atomic, strong) LSSpanContext *context;
 @property(nonatomic, strong) NSMutableArray<LSLog *> *logs;
 @property(atomic, strong, readonly) NSMutableDictionary<NSString *, NSString *> *mutableTags;
+// The tracer owns its non-recording span, so that span refers back to it weakly.
+@property(nonatomic, weak, readonly) LSTracer *weakTracer;
+// The start time is kept as micros so that spans started without one do not allocate an NSDate.
+@property(nonatomic, readonly) SInt64 startMicros;
 @end
 
 @implementation LSSpan
 
+@synthesize tracer = _tracer;
+
 - (instancetype)initWithTracer:(LSTracer *)client {
     return [self initWithTracer:client operationName:@"" parent:nil tags:nil startTime:nil];
 }
 
+- (instancetype)initNonRecordingWithTracer:(LSTracer *)tracer {
+    if (self = [super init]) {
+        _weakTracer = tracer;
+        _operationName = @"";
+        _startMicros = [[NSDate distantPast] toMicros];
+        // A zero span id marks the context as non-recording; children started from it are not recorded either.
+        _context = [[LSSpanContext alloc] initWithTraceId:0 spanId:0 baggage:nil];
+        _recording = false;
+    }
+    return self;
+}
+
 - (instancetype)initWithTracer:(LSTracer *)tracer
                  operationName:(NSString *)operationName
                         parent:(nullable LSSpanContext *)parent
@@ -58,8 +77,9 @@
                      startTime:(nullable NSDate *)startTime {
     if (self = [super init]) {
         _tracer = tracer;
-        _operationName = operationName;
-        _startTime = startTime ?: [NSDate date];
+        _operationName = [tracer.stringInterner intern:operationName];
+        _startMicros = startTime != nil ? [startTime toMicros] : [LSClockState nowMicros];
+        _recording = true;
         _logs = @[].mutableCopy;
         _mutableTags = @{}.mutableCopy;
         _parent = parent;
@@ -67,18 +87,52 @@
         UInt64 traceId = parent.traceId ?: [LSUtil generateGUID];
         UInt64 spanId = [LSUtil generateGUID];
         _context = [[LSSpanContext alloc] initWithTraceId:traceId spanId:spanId baggage:parent.baggage];
+        [tracer _spanStartedInTrace:traceId];
 
         [self addTags:tags];
     }
     return self;
 }
 
+- (LSTracer *)tracer {
+    return _tracer ?: self.weakTracer;
+}
+
+- (NSDate *)startTime {
+    return [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)self.startMicros / USEC_PER_SEC];
+}
+
 - (NSDictionary<NSString *, NSString *> *)tags {
-    return [self.mutableTags copy];
+    return [self.mutableTags copy] ?: @{};
 }
 
 - (void)setTag:(NSString *)key value:(NSString *)value {
-    [self.mutableTags setObject:value forKey:key];
+    if (!_recording) {
+        return;
+    }
+    LSStringInterner *interner = self.tracer.stringInterner;
+    [self.mutableTags setObject:[interner internValue:value] forKey:[interner intern:key]];
+}
+
+- (void)setTag:(NSString *)key boolValue:(BOOL)value {
+    if (!_recording) {
+        return;
+    }
+    [self.mutableTags setObject:@(value) forKey:[self.tracer.stringInterner intern:key]];
+}
+
+- (void)setTag:(NSString *)key integerValue:(SInt64)value {
+    if (!_recording) {
+        return;
+    }
+    [self.mutableTags setObject:@(value) forKey:[self.tracer.stringInterner intern:key]];
+}
+
+- (void)setTag:(NSString *)key doubleValue:(double)value {
+    if (!_recording) {
+        return;
+    }
+    [self.mutableTags setObject:@(value) forKey:[self.tracer.stringInterner intern:key]];
 }
 
 - (void)logEvent:(NSString *)eventName {
@@ -92,8 +146,7 @@
 - (void)log:(NSString *)eventName timestamp:(NSDate *)timestamp payload:(NSObject *)payload {
     // No locking is required as all the member variables used below are immutable
     // after initialization.
-
-    if (!self.tracer.enabled) {
+    if (!_recording) {
         return;
     }
 
@@ -102,7 +155,8 @@
         fields[@"event"] = eventName;
     }
     if (payload != nil) {
-        NSString *payloadJSON = [LSUtil objectToJSONString:payload maxLength:[self.tracer maxPayloadJSONLength]];
+        NSString *payloadJSON =
+            [LSUtil objectToTruncatedJSONString:payload maxLength:[self.tracer maxPayloadJSONLength]];
         fields[@"payload_json"] = payloadJSON;
     }
     [self _appendLog:[[LSLog alloc] initWithTimestamp:timestamp fields:fields]];
@@ -115,7 +169,7 @@
 - (void)log:(NSDictionary<NSString *, NSObject *> *)fields timestamp:(nullable NSDate *)timestamp {
     // No locking is required as all the member variables used below are immutable
     // after initialization.
-    if (!self.tracer.enabled) {
+    if (!_recording) {
         return;
     }
     [self _appendLog:[[LSLog alloc] initWithTimestamp:timestamp fields:fields]];
@@ -130,6 +184,9 @@
 }
 
 - (void)finishWithTime:(NSDate *)finishTime {
+    if (!_recording) {
+        return;
+    }
     if (finishTime == nil) {
         finishTime = [NSDate date];
     }
@@ -143,6 +200,10 @@
 
 - (id<OTSpan>)setBaggageItem:(NSString *)key value:(NSString *)value {
     // TODO: change selector in OTSpan.h to setBaggageItem:forKey:
+    if (!_recording) {
+        // The non-recording context is shared; never mutate it.
+        return self;
+    }
     self.context = [self.context withBaggageItem:key value:value];
     return self;
 }
@@ -154,10 +215,13 @@
 
 /// Add a set of tags from the given dictionary. Existing key-value pairs will be overwritten by any new tags.
 - (void)addTags:(NSDictionary *)tags {
-    if (tags == nil) {
+    if (tags == nil || !_recording) {
         return;
     }
-    [self.mutableTags addEntriesFromDictionary:tags];
+    LSStringInterner *interner = self.tracer.stringInterner;
+    for (NSString *key in tags) {
+        [self.mutableTags setObject:tags[key] forKey:[interner intern:key]];
+    }
 }
 
 - (NSString *)tagForKey:(NSString *)key {
@@ -195,7 +259,7 @@
         @"trace_guid": self.context.hexTraceId,
         @"span_guid": self.context.hexSpanId,
         @"span_name": self.operationName,
-        @"oldest_micros": @([self.startTime toMicros]),
+        @"oldest_micros": @(self.startMicros),
         @"youngest_micros": @([finishTime toMicros]),
         @"attributes": attributes,
         @"log_records": logs,
@@ -0,0 +1,40 @@
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// A bounded table of canonical string instances.
+///
+/// Operation names and tag keys repeat across nearly every buffered span. Interning them lets those
+/// spans share a single instance of each string instead of each retaining its own copy. Tag values are usually
+/// one-off (ids, URLs), so they go through `internValue:`, which only admits a value the second time it is seen and
+/// never lets values take more than half of the table.
+///
+/// The table never evicts: once it is full (or for strings longer than `maxStringLength`), `intern:` simply returns
+/// its argument, so high-cardinality values cannot grow it without bound.
+///
+/// LSStringInterner is thread-safe.
+@interface LSStringInterner : NSObject
+
+/// @returns An `LSStringInterner` holding at most 4096 strings of at most 128 characters each.
+- (instancetype)init;
+
+- (instancetype)initWithMaxStrings:(NSUInteger)maxStrings maxStringLength:(NSUInteger)maxStringLength;
+
+/// For names and keys.
+///
+/// @returns The canonical instance equal to `string`, or `string` itself if it is not (and cannot be) interned.
+- (NSString *)intern:(NSString *)string;
+
+/// For tag values. Like `intern:`, except that a value is only added to the table once it has been seen before
+/// (tracked by hash in a small fixed-size filter, so one-off values pin no memory), and only while values hold less
+/// than half of the table.
+///
+/// @returns The canonical instance equal to `string`, or `string` itself if it is not (yet) interned.
+- (NSString *)internValue:(NSString *)string;
+
+/// The number of strings currently interned.
+@property(atomic, readonly) NSUInteger count;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,91 @@
+#import "LSStringInterner.h"
+
+static const NSUInteger LSDefaultInternerMaxStrings = 4096;
+static const NSUInteger LSDefaultInternerMaxStringLength = 128;
+// Slots in the direct-mapped filter of value hashes seen once.
+#define LSInternerSeenValueSlots 1024
+
+@interface LSStringInterner ()
+@property(nonatomic, readonly) NSUInteger maxStrings;
+@property(nonatomic, readonly) NSUInteger maxStringLength;
+@property(nonatomic, strong, readonly) NSMutableSet<NSString *> *strings;
+@property(nonatomic) NSUInteger valueCount;
+@end
+
+@implementation LSStringInterner {
+    NSUInteger _seenValueHashes[LSInternerSeenValueSlots];
+}
+
+- (instancetype)init {
+    return [self initWithMaxStrings:LSDefaultInternerMaxStrings maxStringLength:LSDefaultInternerMaxStringLength];
+}
+
+- (instancetype)initWithMaxStrings:(NSUInteger)maxStrings maxStringLength:(NSUInteger)maxStringLength {
+    if (self = [super init]) {
+        _maxStrings = maxStrings;
+        _maxStringLength = maxStringLength;
+        _strings = [NSMutableSet setWithCapacity:MIN(maxStrings, 256)];
+    }
+    return self;
+}
+
+- (NSString *)intern:(NSString *)string {
+    // Tag dictionaries are untyped at runtime, so keys and values may be any object.
+    if (![string isKindOfClass:[NSString class]] || string.length > self.maxStringLength) {
+        return string;
+    }
+    @synchronized(self) {
+        NSString *canonical = [self.strings member:string];
+        if (canonical != nil) {
+            return canonical;
+        }
+        return [self _addString:string];
+    }
+}
+
+- (NSString *)internValue:(NSString *)string {
+    if (![string isKindOfClass:[NSString class]] || string.length > self.maxStringLength) {
+        return string;
+    }
+    @synchronized(self) {
+        NSString *canonical = [self.strings member:string];
+        if (canonical != nil) {
+            return canonical;
+        }
+        NSUInteger hash = string.hash;
+        NSUInteger *seen = &_seenValueHashes[hash % LSInternerSeenValueSlots];
+        if (*seen != hash) {
+            // First sighting (as far as the filter can tell).
+            *seen = hash;
+            return string;
+        }
+        if (self.valueCount >= self.maxStrings / 2) {
+            return string;
+        }
+        NSUInteger countBefore = self.strings.count;
+        canonical = [self _addString:string];
+        if (self.strings.count > countBefore) {
+            self.valueCount++;
+        }
+        return canonical;
+    }
+}
+
+// Must be called while holding the lock. Returns `string` itself if the table is full.
+- (NSString *)_addString:(NSString *)string {
+    if (self.strings.count >= self.maxStrings) {
+        return string;
+    }
+    // Store an immutable copy so later mutation of a caller's NSMutableString cannot corrupt the table.
+    NSString *canonical = [string copy];
+    [self.strings addObject:canonical];
+    return canonical;
+}
+
+- (NSUInteger)count {
+    @synchronized(self) {
+        return self.strings.count;
+    }
+}
+
+@end
@@ -0,0 +1,87 @@
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// A custom retention rule. Receives every finished span record buffered for a trace and returns true if the trace
+/// should be reported.
+typedef BOOL (^LSTraceRetentionRule)(NSArray<NSDictionary *> *spanRecords);
+
+/// Local tail-based trace retention.
+///
+/// An `LSTraceAssembler` holds finished span records (keyed by `LSSpanContext.traceId`) until every span started
+/// locally in that trace has finished, and then decides whether the whole trace is worth reporting. A trace is
+/// retained if any of the configured rules match; otherwise all of its spans are discarded.
+///
+/// Memory is bounded by `maxBufferedSpans`, and traces that never complete are evicted after `maxTraceAgeSeconds`.
+/// Evicted traces are evaluated against the same rules using the spans that have finished so far. The verdicts of the
+/// most recent such traces are remembered, so spans finishing after their trace was evicted are reported or dropped
+/// to match it.
+///
+/// Attach an assembler via `-[LSTracer setTraceAssembler:]` before starting spans.
+///
+/// LSTraceAssembler is thread-safe.
+@interface LSTraceAssembler : NSObject
+
+/// @returns An `LSTraceAssembler` that buffers at most 5000 spans for at most 60 seconds per trace.
+- (instancetype)init;
+
+/// @param maxBufferedSpans the maximum number of finished spans held across all pending traces
+/// @param maxTraceAgeSeconds the maximum time a trace may stay pending before it is evicted
+- (instancetype)initWithMaxBufferedSpans:(NSUInteger)maxBufferedSpans
+                      maxTraceAgeSeconds:(NSTimeInterval)maxTraceAgeSeconds;
+
+#pragma mark - Retention rules
+
+/// If true, traces containing a span with a truthy "error" tag are retained. Defaults to true.
+@property(atomic) BOOL retainErrors;
+
+/// If non-zero, traces whose local wall-clock duration is at least this long are retained. Defaults to 0.
+@property(atomic) SInt64 durationThresholdMicros;
+
+/// If non-nil, traces containing a span with one of these operation names are retained.
+@property(atomic, copy, nullable) NSSet<NSString *> *retainedOperationNames;
+
+/// An optional additional rule consulted after the built-in ones.
+@property(atomic, copy, nullable) LSTraceRetentionRule retentionRule;
+
+#pragma mark - Statistics
+
+/// The number of traces that matched a rule and were handed back for reporting.
+@property(atomic, readonly) NSUInteger retainedTraceCount;
+
+/// The number of traces that matched no rule and were dropped.
+@property(atomic, readonly) NSUInteger discardedTraceCount;
+
+/// The number of finished spans currently held.
+@property(atomic, readonly) NSUInteger bufferedSpanCount;
+
+/// The number of traces currently pending, including those with no finished spans yet.
+@property(atomic, readonly) NSUInteger pendingTraceCount;
+
+#pragma mark - Internal
+
+/// Internal function.
+///
+/// Registers a newly-started span so the trace is not considered complete until it finishes. Returns the span records
+/// of any traces evicted to make room that matched a retention rule; these should be reported.
+- (NSArray<NSDictionary *> *)spanStartedInTrace:(UInt64)traceId;
+
+/// Internal function.
+///
+/// Buffers a finished span record. Returns the span records of any traces that completed (or were evicted) and
+/// matched a retention rule; these should be reported.
+- (NSArray<NSDictionary *> *)addSpanJSON:(NSDictionary *)spanJSON;
+
+/// Internal function.
+///
+/// Evicts traces older than `maxTraceAgeSeconds`, returning the span records of those that should be reported.
+- (NSArray<NSDictionary *> *)evictExpiredTraces;
+
+/// Internal function.
+///
+/// Evicts every pending trace (e.g. at shutdown), returning the span records of those that should be reported.
+- (NSArray<NSDictionary *> *)evictAllTraces;
+
+@end
+
+NS_ASSUME_NONNULL_END
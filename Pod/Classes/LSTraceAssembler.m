@@ -0,0 +1,221 @@
+#import "LSTraceAssembler.h"
+#import "LSClockState.h"
+#import "LSUtil.h"
+
+static const NSUInteger LSDefaultAssemblerMaxBufferedSpans = 5000;
+static const NSTimeInterval LSDefaultAssemblerMaxTraceAgeSeconds = 60;
+
+#pragma mark - LSPendingTrace
+
+/// The locally-finished portion of a single trace.
+@interface LSPendingTrace : NSObject
+
+@property(nonatomic) NSInteger openSpans;
+@property(nonatomic, readonly) SInt64 createdMicros;
+@property(nonatomic, strong, readonly) NSMutableArray<NSDictionary *> *spans;
+
+@end
+
+@implementation LSPendingTrace
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _createdMicros = [LSClockState nowMicros];
+        _spans = [NSMutableArray<NSDictionary *> array];
+    }
+    return self;
+}
+
+@end
+
+#pragma mark - LSTraceAssembler
+
+@interface LSTraceAssembler ()
+@property(nonatomic, readonly) NSUInteger maxBufferedSpans;
+@property(nonatomic, readonly) SInt64 maxTraceAgeMicros;
+@property(nonatomic, strong, readonly) NSMutableDictionary<NSNumber *, LSPendingTrace *> *traces;
+// Trace ids in creation order, so the oldest trace is always first.
+@property(nonatomic, strong, readonly) NSMutableOrderedSet<NSNumber *> *traceOrder;
+// Whether each trace evicted with unfinished spans was retained, so its late spans follow the same verdict.
+@property(nonatomic, strong, readonly) NSMutableDictionary<NSNumber *, NSNumber *> *decidedTraces;
+// Keys of `decidedTraces` in decision order, so the oldest verdict is forgotten first.
+@property(nonatomic, strong, readonly) NSMutableOrderedSet<NSNumber *> *decidedOrder;
+@property(atomic, readwrite) NSUInteger retainedTraceCount;
+@property(atomic, readwrite) NSUInteger discardedTraceCount;
+@property(atomic, readwrite) NSUInteger bufferedSpanCount;
+@end
+
+@implementation LSTraceAssembler
+
+- (instancetype)init {
+    return [self initWithMaxBufferedSpans:LSDefaultAssemblerMaxBufferedSpans
+                       maxTraceAgeSeconds:LSDefaultAssemblerMaxTraceAgeSeconds];
+}
+
+- (instancetype)initWithMaxBufferedSpans:(NSUInteger)maxBufferedSpans
+                      maxTraceAgeSeconds:(NSTimeInterval)maxTraceAgeSeconds {
+    if (self = [super init]) {
+        _maxBufferedSpans = MAX(maxBufferedSpans, 1);
+        _maxTraceAgeMicros = (SInt64)(maxTraceAgeSeconds * USEC_PER_SEC);
+        _traces = [NSMutableDictionary dictionary];
+        _traceOrder = [NSMutableOrderedSet orderedSet];
+        _decidedTraces = [NSMutableDictionary dictionary];
+        _decidedOrder = [NSMutableOrderedSet orderedSet];
+        _retainErrors = true;
+    }
+    return self;
+}
+
+- (NSArray<NSDictionary *> *)spanStartedInTrace:(UInt64)traceId {
+    NSMutableArray<NSDictionary *> *retained = [NSMutableArray array];
+    @synchronized(self) {
+        if (self.decidedTraces[@(traceId)] != nil) {
+            // The trace has already been judged; there is nothing to wait for.
+            return retained;
+        }
+        [self _traceForId:@(traceId)].openSpans++;
+        // Traces made only of unfinished spans count against the cap too. The new trace is last, so it is never the
+        // one evicted.
+        while (self.traceOrder.count > self.maxBufferedSpans) {
+            [self _completeTraceWithId:self.traceOrder.firstObject into:retained];
+        }
+    }
+    return retained;
+}
+
+- (NSArray<NSDictionary *> *)addSpanJSON:(NSDictionary *)spanJSON {
+    NSMutableArray<NSDictionary *> *retained = [NSMutableArray array];
+    @synchronized(self) {
+        NSNumber *traceId = @([LSUtil guidFromHex:spanJSON[@"trace_guid"]]);
+        NSNumber *verdict = self.decidedTraces[traceId];
+        if (verdict != nil) {
+            // A late span from an evicted trace: report it now if the trace was retained, and count nothing again.
+            if (verdict.boolValue) {
+                [retained addObject:spanJSON];
+            }
+        } else {
+            LSPendingTrace *trace = [self _traceForId:traceId];
+            [trace.spans addObject:spanJSON];
+            self.bufferedSpanCount++;
+            trace.openSpans--;
+            if (trace.openSpans <= 0) {
+                [self _completeTraceWithId:traceId into:retained];
+            }
+        }
+
+        [self _evictExpiredTracesInto:retained];
+        // Bound memory: both the finished spans and the number of traces that may be waiting on unfinished spans.
+        while (self.traceOrder.count > 0 &&
+               (self.bufferedSpanCount > self.maxBufferedSpans || self.traceOrder.count > self.maxBufferedSpans)) {
+            [self _completeTraceWithId:self.traceOrder.firstObject into:retained];
+        }
+    }
+    return retained;
+}
+
+- (NSArray<NSDictionary *> *)evictExpiredTraces {
+    NSMutableArray<NSDictionary *> *retained = [NSMutableArray array];
+    @synchronized(self) {
+        [self _evictExpiredTracesInto:retained];
+    }
+    return retained;
+}
+
+- (NSArray<NSDictionary *> *)evictAllTraces {
+    NSMutableArray<NSDictionary *> *retained = [NSMutableArray array];
+    @synchronized(self) {
+        while (self.traceOrder.count > 0) {
+            [self _completeTraceWithId:self.traceOrder.firstObject into:retained];
+        }
+    }
+    return retained;
+}
+
+- (NSUInteger)pendingTraceCount {
+    @synchronized(self) {
+        return self.traceOrder.count;
+    }
+}
+
+#pragma mark - Private
+
+// Must be called while holding the lock.
+- (LSPendingTrace *)_traceForId:(NSNumber *)traceId {
+    LSPendingTrace *trace = self.traces[traceId];
+    if (trace == nil) {
+        trace = [[LSPendingTrace alloc] init];
+        self.traces[traceId] = trace;
+        [self.traceOrder addObject:traceId];
+    }
+    return trace;
+}
+
+// Must be called while holding the lock.
+- (void)_evictExpiredTracesInto:(NSMutableArray<NSDictionary *> *)retained {
+    SInt64 cutoffMicros = [LSClockState nowMicros] - self.maxTraceAgeMicros;
+    while (self.traceOrder.count > 0) {
+        NSNumber *oldest = self.traceOrder.firstObject;
+        if (self.traces[oldest].createdMicros > cutoffMicros) {
+            return;
+        }
+        [self _completeTraceWithId:oldest into:retained];
+    }
+}
+
+// Removes the trace and, if it matches a retention rule, appends its spans to `retained`. Must be called while
+// holding the lock.
+- (void)_completeTraceWithId:(NSNumber *)traceId into:(NSMutableArray<NSDictionary *> *)retained {
+    LSPendingTrace *trace = self.traces[traceId];
+    [self.traces removeObjectForKey:traceId];
+    [self.traceOrder removeObject:traceId];
+    if (trace.spans.count == 0) {
+        // Only unfinished spans; there is nothing to judge or report.
+        return;
+    }
+    self.bufferedSpanCount -= trace.spans.count;
+
+    BOOL retain = [self _shouldRetainSpans:trace.spans];
+    if (retain) {
+        self.retainedTraceCount++;
+        [retained addObjectsFromArray:trace.spans];
+    } else {
+        self.discardedTraceCount++;
+    }
+    if (trace.openSpans > 0) {
+        [self _recordVerdict:retain forTraceId:traceId];
+    }
+}
+
+// Must be called while holding the lock.
+- (void)_recordVerdict:(BOOL)retain forTraceId:(NSNumber *)traceId {
+    self.decidedTraces[traceId] = @(retain);
+    [self.decidedOrder addObject:traceId];
+    while (self.decidedOrder.count > self.maxBufferedSpans) {
+        [self.decidedTraces removeObjectForKey:self.decidedOrder.firstObject];
+        [self.decidedOrder removeObjectAtIndex:0];
+    }
+}
+
+- (BOOL)_shouldRetainSpans:(NSArray<NSDictionary *> *)spans {
+    SInt64 durationThresholdMicros = self.durationThresholdMicros;
+    NSSet<NSString *> *operationNames = self.retainedOperationNames;
+    SInt64 oldestMicros = INT64_MAX;
+    SInt64 youngestMicros = INT64_MIN;
+    for (NSDictionary *span in spans) {
+        if (self.retainErrors && [LSUtil spanJSONHasErrorTag:span]) {
+            return true;
+        }
+        if ([operationNames containsObject:span[@"span_name"]]) {
+            return true;
+        }
+        oldestMicros = MIN(oldestMicros, [span[@"oldest_micros"] longLongValue]);
+        youngestMicros = MAX(youngestMicros, [span[@"youngest_micros"] longLongValue]);
+    }
+    if (durationThresholdMicros > 0 && youngestMicros - oldestMicros >= durationThresholdMicros) {
+        return true;
+    }
+    LSTraceRetentionRule rule = self.retentionRule;
+    return rule != nil && rule(spans);
+}
+
+@end
@@ -1,6 +1,10 @@
 #import <Foundation/Foundation.h>
 
+#import "LSScope.h"
 #import "LSSpan.h"
+#import "LSStringInterner.h"
+#import "LSTransport.h"
+#import "LSTraceAssembler.h"
 #import <opentracing/OTTracer.h>
 
 NS_ASSUME_NONNULL_BEGIN
@@ -53,6 +57,32 @@ extern NSInteger const LSBackgroundTaskError;
 
 #pragma mark - LightStep extensions and internal methods
 
+/// Start a span without the intermediate collections the OTTracer `startSpan:` overloads allocate (no OTReference,
+/// references array or tags dictionary). Set tags afterwards with the typed `-[LSSpan setTag:...]` setters.
+///
+/// @param operationName the operation name for the new span
+/// @param parent the parent span context, or nil to use the active span (see `activeSpan`), or to start a new trace
+///               if there is none
+- (LSSpan *)startSpan:(NSString *)operationName parentContext:(nullable LSSpanContext *)parent;
+
+/// Start a span that begins a new trace, ignoring the active span. Use this for work that should not be attributed
+/// to whatever happened to be active, e.g. a background job dispatched with `LSDispatchAsync`.
+///
+/// @param operationName the operation name for the new span
+- (LSSpan *)startRootSpan:(NSString *)operationName;
+
+/// The span active on the current thread, or nil. Spans started by this tracer without an explicit parent become
+/// children of the active span when it belongs to this tracer.
+@property(nonatomic, readonly, nullable) LSSpan *activeSpan;
+
+/// Make `span` the current thread's active span until the returned scope is closed. Use `LSDispatchAsync` and
+/// friends (see LSScope.h) to carry the active span across queue hops.
+///
+///     LSScope *scope = [tracer activateSpan:span];
+///     ...
+///     [scope close];
+- (LSScope *)activateSpan:(nullable LSSpan *)span;
+
 /// The remote service base URL
 @property(nonatomic, strong, readonly) NSURL *baseURL;
 
@@ -61,29 +91,92 @@ extern NSInteger const LSBackgroundTaskError;
 
 /// HTTP session to be used for performing requests. This enables sharing a connnection pool with your own app.
 /// It should be set during initialization, ideally before starting and finishing Spans.
+///
+/// Only used by the default transport, an `LSHTTPTransport` posting to `baseURL`.
 @property(nonatomic, strong) NSURLSession *urlSession;
 
+/// How reports are delivered. Defaults to an `LSHTTPTransport` posting to `baseURL`; set an
+/// `LSUnixSocketTransport` to report through a forwarding agent on the same host instead. Setting nil restores the
+/// default.
+@property(atomic, strong, null_resettable) id<LSTransport> transport;
+
 /// The `LSTracer` instance's maximum number of records to buffer between reports.
 @property(atomic) NSUInteger maxSpanRecords;
 
+/// The maximum estimated encoded size, in bytes, of the records buffered between reports. Defaults to 2MB.
+///
+/// When either this or `maxSpanRecords` is exceeded, the oldest buffered span that is neither a root span nor tagged
+/// as an error is dropped. Root and error spans are dropped, oldest first, only when nothing else is left.
+@property(atomic) NSUInteger maxBufferedBytes;
+
+/// The estimated encoded size, in bytes, of the records currently buffered.
+@property(atomic, readonly) NSUInteger bufferedBytes;
+
+/// The total number of finished spans dropped because the buffer was full.
+@property(atomic, readonly) NSUInteger droppedSpanCount;
+
+/// The interval between automatic background flushes, or 0 for none. Changing it re-arms the existing flush timer.
+@property(atomic) NSUInteger flushIntervalSeconds;
+
+/// The probability, between 0 and 1, that a new trace is recorded. The decision is made when a root span starts;
+/// an unsampled root and all of its descendants are non-recording. Defaults to 1.
+@property(atomic) double sampleRate;
+
 /// Maximum string length of any single JSON payload.
 @property(atomic) NSUInteger maxPayloadJSONLength;
 
 /// If true, the library is currently buffering and reporting data. If set to false, tracing data is no longer
-/// collected.
+/// collected: new spans are a shared, non-recording instance (see `-[LSSpan isRecording]`).
 @property(atomic) BOOL enabled;
 
+/// Reconfigure a running tracer, e.g. from a local configuration file or a remote response decoded with
+/// NSJSONSerialization. Recognized keys (all optional) are "enabled", "max_span_records",
+/// "max_buffered_bytes", "max_payload_json_length", "flush_interval_seconds" and "sample_rate"; others are ignored.
+///
+/// The tracer is not rebuilt and buffered spans are kept.
+- (void)applyConfiguration:(NSDictionary<NSString *, id> *)configuration;
+
 /// Tracer's access token
 @property(atomic, strong, readonly) NSString *accessToken;
 
+/// Canonical instances of operation names, tag keys and tag values shared by this tracer's buffered spans.
+@property(nonatomic, strong, readonly) LSStringInterner *stringInterner;
+
+/// Optional tail-based retention. When set, finished spans are held per trace by the assembler and only buffered for
+/// reporting once their trace completes and matches one of its rules. It should be set before starting spans.
+@property(atomic, strong, nullable) LSTraceAssembler *traceAssembler;
+
 /// Record a span.
 - (void)_appendSpanJSON:(NSDictionary *)spanRecord;
 
+/// Internal function.
+///
+/// Called as a recording span starts, so the `traceAssembler` (if any) can track the trace.
+- (void)_spanStartedInTrace:(UInt64)traceId;
+
 /// Flush any buffered data to the collector. Returns without blocking.
 ///
-/// If non-nil, doneCallback will be invoked once the flush()completes.
+/// If non-nil, doneCallback will be invoked once the flush()completes, on every platform, including when there was
+/// nothing to report.
 - (void)flush:(nullable void (^)(NSError *_Nullable error))doneCallback;
 
+/// The total number of spans the collector has acknowledged.
+@property(atomic, readonly) NSUInteger reportedSpanCount;
+
+/// Flush any buffered data and wait until it, and any report already in flight, has completed or `timeout`
+/// seconds have passed, whichever comes first. Blocks the calling thread.
+///
+/// @returns The number of spans acknowledged by the collector while waiting.
+- (NSUInteger)drainWithTimeout:(NSTimeInterval)timeout;
+
+/// Stop the flush timer, drain (see `drainWithTimeout:`), and then disable the tracer. Spans that finish once this
+/// has been called are dropped, and the tracer cannot be re-enabled. Traces held by the `traceAssembler` are
+/// evaluated as-is and reported if they match. Intended for process exit and short-lived
+/// command-line tools. Blocks the calling thread.
+///
+/// @returns The number of spans acknowledged by the collector while waiting.
+- (NSUInteger)shutdownWithTimeout:(NSTimeInterval)timeout;
+
 @end
 
 NS_ASSUME_NONNULL_END
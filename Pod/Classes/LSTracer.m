@@ -7,6 +7,7 @@
 #import <opentracing/OTReference.h>
 
 #import "LSClockState.h"
+#import "LSHTTPTransport.h"
 #import "LSSpan.h"
 #import "LSSpanContext.h"
 #import "LSTracer.h"
@@ -18,21 +19,137 @@ static const int LSDefaultFlushIntervalSeconds = 30;
 static const NSUInteger LSDefaultMaxBufferedSpans = 5000;
 static const NSUInteger LSDefaultMaxPayloadJSONLength = 32 * 1024;
 static const NSUInteger LSMaxRequestSize = 1024 * 1024 * 4; // 4MB
+// Leaves headroom under LSMaxRequestSize for the report envelope and for non-ASCII text the size estimate undercounts.
+static const NSUInteger LSDefaultMaxBufferedBytes = LSMaxRequestSize / 2;
 NSInteger const LSBackgroundTaskError = 1;
 NSInteger const LSRequestTooLargeError = 2;
 NSString *const LSErrorDomain = @"com.lightstep";
 
+#pragma mark - LSSpanBuffer
+
+/// Span records waiting for the next report, with their estimated encoded size.
+///
+/// Spans tagged as errors and root spans are high priority. Once a limit is reached the oldest low-priority span is
+/// evicted first, and a high-priority span only when no low-priority one is left. Not thread-safe; the tracer guards
+/// it with its own lock.
+@interface LSSpanBuffer : NSObject
+@property(nonatomic, readonly) NSUInteger count;
+@property(nonatomic, readonly) NSUInteger bytes;
++ (NSUInteger)sizeOfSpanJSON:(NSDictionary *)spanJSON;
++ (BOOL)isHighPrioritySpanJSON:(NSDictionary *)spanJSON;
+- (NSUInteger)addSpanJSON:(NSDictionary *)spanJSON
+                     size:(NSUInteger)size
+             highPriority:(BOOL)highPriority
+                 maxCount:(NSUInteger)maxCount
+                 maxBytes:(NSUInteger)maxBytes;
+- (NSMutableArray<NSDictionary *> *)takeAll;
+@end
+
+@interface LSSpanBuffer ()
+// Each queue is oldest first, with a parallel array of estimated sizes.
+@property(nonatomic, strong) NSMutableArray<NSDictionary *> *highPrioritySpans;
+@property(nonatomic, strong) NSMutableArray<NSNumber *> *highPrioritySizes;
+@property(nonatomic, strong) NSMutableArray<NSDictionary *> *lowPrioritySpans;
+@property(nonatomic, strong) NSMutableArray<NSNumber *> *lowPrioritySizes;
+@property(nonatomic, readwrite) NSUInteger bytes;
+@end
+
+@implementation LSSpanBuffer
+
+- (instancetype)init {
+    if (self = [super init]) {
+        [self _reset];
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return self.highPrioritySpans.count + self.lowPrioritySpans.count;
+}
+
+// Returns the number of spans dropped to stay within the limits, which may include `spanJSON` itself. `size` and
+// `highPriority` come from +[LSSpanBuffer sizeOfSpanJSON:] and +[LSSpanBuffer isHighPrioritySpanJSON:], which walk
+// the record and so are best called before taking whatever lock guards the buffer.
+- (NSUInteger)addSpanJSON:(NSDictionary *)spanJSON
+                     size:(NSUInteger)size
+             highPriority:(BOOL)highPriority
+                 maxCount:(NSUInteger)maxCount
+                 maxBytes:(NSUInteger)maxBytes {
+    if (maxCount == 0 || size > maxBytes) {
+        // Never worth evicting anything for.
+        return 1;
+    }
+    if (highPriority) {
+        [self.highPrioritySpans addObject:spanJSON];
+        [self.highPrioritySizes addObject:@(size)];
+    } else {
+        [self.lowPrioritySpans addObject:spanJSON];
+        [self.lowPrioritySizes addObject:@(size)];
+    }
+    self.bytes += size;
+
+    NSUInteger dropped = 0;
+    while (self.count > maxCount || self.bytes > maxBytes) {
+        BOOL evictLow = self.lowPrioritySpans.count > 0;
+        NSMutableArray<NSDictionary *> *spans = evictLow ? self.lowPrioritySpans : self.highPrioritySpans;
+        NSMutableArray<NSNumber *> *sizes = evictLow ? self.lowPrioritySizes : self.highPrioritySizes;
+        self.bytes -= sizes.firstObject.unsignedIntegerValue;
+        [spans removeObjectAtIndex:0];
+        [sizes removeObjectAtIndex:0];
+        dropped++;
+    }
+    return dropped;
+}
+
++ (NSUInteger)sizeOfSpanJSON:(NSDictionary *)spanJSON {
+    return [LSUtil estimatedJSONLengthOfObject:spanJSON];
+}
+
++ (BOOL)isHighPrioritySpanJSON:(NSDictionary *)spanJSON {
+    return [LSUtil spanJSONHasErrorTag:spanJSON] || [LSUtil spanJSONIsRoot:spanJSON];
+}
+
+// Empties the buffer, returning everything it held.
+- (NSMutableArray<NSDictionary *> *)takeAll {
+    NSMutableArray<NSDictionary *> *spans = self.highPrioritySpans;
+    [spans addObjectsFromArray:self.lowPrioritySpans];
+    [self _reset];
+    return spans;
+}
+
+- (void)_reset {
+    self.highPrioritySpans = [NSMutableArray<NSDictionary *> array];
+    self.highPrioritySizes = [NSMutableArray<NSNumber *> array];
+    self.lowPrioritySpans = [NSMutableArray<NSDictionary *> array];
+    self.lowPrioritySizes = [NSMutableArray<NSNumber *> array];
+    self.bytes = 0;
+}
+
+@end
+
 #pragma mark - Private properties
 
 @interface LSTracer ()
-@property(nonatomic, strong) NSMutableArray<NSDictionary *> *pendingJSONSpans;
+@property(nonatomic, strong, readonly) LSSpanBuffer *pendingSpans;
+@property(atomic, readwrite) NSUInteger droppedSpanCount;
+@property(nonatomic, strong, readonly) NSString *componentName;
+// Both are built lazily, on the first timer tick or flush, to keep them off the constructing thread.
 @property(nonatomic, strong, readonly) NSDictionary<NSString *, id> *tracerJSON;
 @property(nonatomic, strong, readonly) LSClockState *clockState;
 
 @property(nonatomic, strong, readonly) dispatch_queue_t flushQueue;
 @property(nonatomic, strong) dispatch_source_t flushTimer;
+// When the flush timer is next due to fire, or 0 if it is not armed.
+@property(nonatomic) SInt64 nextFlushMicros;
+// Entered for every report from the moment its spans leave the buffer until its request completes.
+@property(nonatomic, strong, readonly) dispatch_group_t inflightGroup;
+@property(atomic) BOOL isShutdown;
+@property(atomic, readwrite) NSUInteger reportedSpanCount;
 @property(nonatomic, strong) NSDate *lastFlush;
 @property(nonatomic) UInt64 runtimeGuid;
+@property(nonatomic, strong, readonly) LSSpan *nonRecordingSpan;
+// The default transport; kept even when another is set so that `urlSession` keeps working.
+@property(nonatomic, strong, readonly) LSHTTPTransport *httpTransport;
 #if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR || TARGET_OS_TV)
 @property(nonatomic) UIBackgroundTaskIdentifier bgTaskId;
 #endif
@@ -42,6 +159,9 @@ NSString *const LSErrorDomain = @"com.lightstep";
 
 @implementation LSTracer
 
+@synthesize tracerJSON = _tracerJSON;
+@synthesize clockState = _clockState;
+
 - (instancetype)initWithToken:(NSString *)accessToken
                 componentName:(NSString *)componentName
                       baseURL:(NSURL *)baseURL
@@ -51,28 +171,34 @@ NSString *const LSErrorDomain = @"com.lightstep";
         _runtimeGuid = [LSUtil generateGUID];
         _maxSpanRecords = LSDefaultMaxBufferedSpans;
         _maxPayloadJSONLength = LSDefaultMaxPayloadJSONLength;
-        _pendingJSONSpans = [NSMutableArray<NSDictionary *> array];
+        _maxBufferedBytes = LSDefaultMaxBufferedBytes;
+        _pendingSpans = [[LSSpanBuffer alloc] init];
+        _stringInterner = [[LSStringInterner alloc] init];
         _flushQueue = dispatch_queue_create("com.lightstep.flush_queue", DISPATCH_QUEUE_SERIAL);
         _flushTimer = nil;
+        _inflightGroup = dispatch_group_create();
         _enabled = true;
-        _clockState = [[LSClockState alloc] init];
+        _sampleRate = 1;
+        _nonRecordingSpan = [[LSSpan alloc] initNonRecordingWithTracer:self];
         _lastFlush = [NSDate date];
         #if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR || TARGET_OS_TV)
         _bgTaskId = UIBackgroundTaskInvalid;
         #endif
         _baseURL = baseURL ?: [NSURL URLWithString:LSDefaultBaseURLString];
-        _tracerJSON = @{
-            @"guid": [LSUtil hexGUID:_runtimeGuid],
-            @"attrs": [LSUtil keyValueArrayFromDictionary:@{
-                @"lightstep.tracer_platform": [LSUtil getTracerPlatform],
-                @"lightstep.tracer_platform_version": [LSUtil getTracerPlatformVersion],
-                @"lightstep.tracer_version": LS_TRACER_VERSION,
-                @"lightstep.component_name": componentName,
-                @"device_model": [LSUtil getDeviceModel]
-            }]
-        };
-
-        [self _forkFlushLoop:flushIntervalSeconds];
+        _httpTransport = [[LSHTTPTransport alloc] initWithURL:_baseURL];
+        _transport = _httpTransport;
+        _flushIntervalSeconds = flushIntervalSeconds;
+        _componentName = componentName;
+
+        // Construction usually happens during app launch, so everything that is not needed to accept spans
+        // (clock state, runtime metadata, the flush timer) is deferred to the flush queue. Finishing it there, rather
+        // than on the first tick, also covers a tracer with no flush timer.
+        __weak __typeof(self) weakSelf = self;
+        dispatch_async(_flushQueue, ^{
+            __typeof(self) strongSelf = weakSelf;
+            [strongSelf _forkFlushLoop:strongSelf.flushIntervalSeconds];
+            [strongSelf _finishDeferredInitialization];
+        });
     }
     return self;
 }
@@ -118,7 +244,26 @@ NSString *const LSErrorDomain = @"com.lightstep";
                 childOf:(id<OTSpanContext>)parent
                    tags:(NSDictionary *)tags
               startTime:(NSDate *)startTime {
-    return [self startSpan:operationName references:@[[OTReference childOf:parent]] tags:tags startTime:startTime];
+    // Equivalent to a single OTReferenceChildOf reference, without allocating one.
+    return [self _startSpan:operationName
+                     parent:(LSSpanContext *)parent ?: [self _activeSpanContext]
+                       tags:tags
+                  startTime:startTime];
+}
+
+- (LSSpan *)startSpan:(NSString *)operationName parentContext:(LSSpanContext *)parent {
+    return [self _startSpan:operationName parent:parent ?: [self _activeSpanContext] tags:nil startTime:nil];
+}
+
+- (LSSpan *)startRootSpan:(NSString *)operationName {
+    return [self _startSpan:operationName parent:nil tags:nil startTime:nil];
+}
+
+static inline BOOL LSIsSupportedReferenceType(NSString *type) {
+    // References are almost always built with the OTReference constants, so compare pointers before falling back
+    // to a string comparison.
+    return type == OTReferenceChildOf || type == OTReferenceFollowsFrom ||
+           [type isEqualToString:OTReferenceChildOf] || [type isEqualToString:OTReferenceFollowsFrom];
 }
 
 - (id<OTSpan>)startSpan:(NSString *)operationName
@@ -128,15 +273,44 @@ NSString *const LSErrorDomain = @"com.lightstep";
     LSSpanContext *parent = nil;
     if (references != nil) {
         for (OTReference *ref in references) {
-            if (ref != nil &&
-                ([ref.type isEqualToString:OTReferenceChildOf] || [ref.type isEqualToString:OTReferenceFollowsFrom])) {
+            if (ref != nil && LSIsSupportedReferenceType(ref.type)) {
                 parent = (LSSpanContext *)ref.referencedContext;
             }
         }
     }
+    return [self _startSpan:operationName parent:parent ?: [self _activeSpanContext] tags:tags startTime:startTime];
+}
+
+// The context of the current thread's active span, if that span belongs to this tracer.
+- (LSSpanContext *)_activeSpanContext {
+    LSSpan *active = LSActiveSpan();
+    return active.tracer == self ? active.context : nil;
+}
+
+- (LSSpan *)activeSpan {
+    return LSActiveSpan();
+}
+
+- (LSScope *)activateSpan:(LSSpan *)span {
+    return [[LSScope alloc] initWithSpan:span];
+}
+
+- (LSSpan *)_startSpan:(NSString *)operationName
+                parent:(LSSpanContext *)parent
+                  tags:(NSDictionary *)tags
+             startTime:(NSDate *)startTime {
+    if (!self.enabled || (parent != nil && parent.spanId == 0)) {
+        // Children of a non-recording span are not recorded either, so unsampled traces are dropped whole.
+        return self.nonRecordingSpan;
+    }
+    if (parent == nil) {
+        double sampleRate = self.sampleRate;
+        if (sampleRate < 1 && (double)arc4random() / UINT32_MAX >= sampleRate) {
+            return self.nonRecordingSpan;
+        }
+    }
     // No locking required
     return [[LSSpan alloc] initWithTracer:self operationName:operationName parent:parent tags:tags startTime:startTime];
-    return nil;
 }
 
 - (BOOL)inject:(id<OTSpanContext>)span format:(NSString *)format carrier:(id)carrier {
@@ -156,6 +330,10 @@ static NSString *kBasicTracerBaggagePrefix = @"ot-baggage-";
          error:(NSError *__autoreleasing *)outError {
     LSSpanContext *ctx = (LSSpanContext *)spanContext;
     if ([format isEqualToString:OTFormatTextMap] || [format isEqualToString:OTFormatHTTPHeaders]) {
+        if ([ctx isKindOfClass:[LSSpanContext class]] && ctx.spanId == 0) {
+            // A non-recording context has nothing to propagate.
+            return true;
+        }
         NSMutableDictionary *dict = carrier;
         [dict setObject:ctx.hexTraceId forKey:kTraceIdKey];
         [dict setObject:ctx.hexSpanId forKey:kSpanIdKey];
@@ -249,48 +427,207 @@ static NSString *kBasicTracerBaggagePrefix = @"ot-baggage-";
 }
 
 - (void)_appendSpanJSON:(NSDictionary *)spanJSON {
+    LSTraceAssembler *assembler = self.traceAssembler;
+    if (assembler == nil) {
+        [self _bufferSpanJSON:spanJSON];
+        return;
+    }
+    if (!self.enabled || self.isShutdown) {
+        return;
+    }
+    for (NSDictionary *retainedJSON in [assembler addSpanJSON:spanJSON]) {
+        [self _bufferSpanJSON:retainedJSON];
+    }
+}
+
+- (void)_spanStartedInTrace:(UInt64)traceId {
+    for (NSDictionary *retainedJSON in [self.traceAssembler spanStartedInTrace:traceId]) {
+        [self _bufferSpanJSON:retainedJSON];
+    }
+}
+
+- (void)_bufferSpanJSON:(NSDictionary *)spanJSON {
+    [self _bufferSpanJSON:spanJSON evenIfShutdown:false];
+}
+
+// Buffers `spanJSON` unless the tracer is disabled or (unless `evenIfShutdown`) shut down.
+- (void)_bufferSpanJSON:(NSDictionary *)spanJSON evenIfShutdown:(BOOL)evenIfShutdown {
+    // Walking the record is the expensive part, so do it before taking the tracer-wide lock.
+    NSUInteger size = [LSSpanBuffer sizeOfSpanJSON:spanJSON];
+    BOOL highPriority = [LSSpanBuffer isHighPrioritySpanJSON:spanJSON];
     @synchronized(self) {
-        if (!self.enabled) {
+        // Once shut down, nothing more will be flushed.
+        if (!self.enabled || (self.isShutdown && !evenIfShutdown)) {
             return;
         }
+        self.droppedSpanCount += [self.pendingSpans addSpanJSON:spanJSON
+                                                           size:size
+                                                   highPriority:highPriority
+                                                       maxCount:self.maxSpanRecords
+                                                       maxBytes:self.maxBufferedBytes];
+    }
+}
 
-        if (self.pendingJSONSpans.count < self.maxSpanRecords) {
-            [self.pendingJSONSpans addObject:spanJSON];
+- (NSUInteger)bufferedBytes {
+    @synchronized(self) {
+        return self.pendingSpans.bytes;
+    }
+}
+
+- (void)applyConfiguration:(NSDictionary<NSString *, id> *)configuration {
+    NSNumber *enabled = configuration[@"enabled"];
+    NSNumber *maxSpanRecords = configuration[@"max_span_records"];
+    NSNumber *maxBufferedBytes = configuration[@"max_buffered_bytes"];
+    NSNumber *maxPayloadJSONLength = configuration[@"max_payload_json_length"];
+    NSNumber *flushIntervalSeconds = configuration[@"flush_interval_seconds"];
+    NSNumber *sampleRate = configuration[@"sample_rate"];
+    if ([enabled isKindOfClass:[NSNumber class]]) {
+        self.enabled = enabled.boolValue;
+    }
+    if ([maxSpanRecords isKindOfClass:[NSNumber class]]) {
+        self.maxSpanRecords = maxSpanRecords.unsignedIntegerValue;
+    }
+    if ([maxBufferedBytes isKindOfClass:[NSNumber class]]) {
+        self.maxBufferedBytes = maxBufferedBytes.unsignedIntegerValue;
+    }
+    if ([maxPayloadJSONLength isKindOfClass:[NSNumber class]]) {
+        self.maxPayloadJSONLength = maxPayloadJSONLength.unsignedIntegerValue;
+    }
+    if ([flushIntervalSeconds isKindOfClass:[NSNumber class]]) {
+        self.flushIntervalSeconds = flushIntervalSeconds.unsignedIntegerValue;
+    }
+    if ([sampleRate isKindOfClass:[NSNumber class]]) {
+        self.sampleRate = MAX(0, MIN(1, sampleRate.doubleValue));
+    }
+}
+
+- (BOOL)enabled {
+    // Read on every span start, so without the lock: a BOOL load cannot tear.
+    return _enabled;
+}
+
+- (void)setEnabled:(BOOL)enabled {
+    @synchronized(self) {
+        // A shut-down tracer has no flush timer and stays disabled.
+        _enabled = enabled && !self.isShutdown;
+    }
+}
+
+- (NSUInteger)flushIntervalSeconds {
+    @synchronized(self) {
+        return _flushIntervalSeconds;
+    }
+}
+
+- (void)setFlushIntervalSeconds:(NSUInteger)flushIntervalSeconds {
+    @synchronized(self) {
+        if (flushIntervalSeconds == _flushIntervalSeconds) {
+            // Re-arming would push the next flush a full interval out.
+            return;
         }
+        _flushIntervalSeconds = flushIntervalSeconds;
+        [self _forkFlushLoop:flushIntervalSeconds];
     }
 }
 
-// Establish the m_flushTimer ticker.
+// Establish the m_flushTimer ticker, or re-arm the existing one with a new interval. An interval of 0 leaves the
+// timer in place but never firing, so it can be re-armed later without being rebuilt.
 - (void)_forkFlushLoop:(NSUInteger)flushIntervalSeconds {
     @synchronized(self) {
-        if (!self.enabled) {
-            // Noop.
+        if (self.isShutdown) {
             return;
         }
-        if (flushIntervalSeconds == 0) {
-            // Noop.
-            return;
+        if (self.flushTimer == nil) {
+            if (flushIntervalSeconds == 0) {
+                // Noop.
+                return;
+            }
+            self.flushTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.flushQueue);
+            if (!self.flushTimer) {
+                return;
+            }
+            __weak __typeof(self) weakSelf = self;
+            dispatch_source_set_event_handler(self.flushTimer, ^{
+                __typeof(self) strongSelf = weakSelf;
+                [strongSelf _flushTimerFired];
+            });
+            dispatch_resume(self.flushTimer);
         }
-        self.flushTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.flushQueue);
-        if (!self.flushTimer) {
-            return;
+        if (flushIntervalSeconds == 0) {
+            dispatch_source_set_timer(self.flushTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+            self.nextFlushMicros = 0;
+        } else {
+            // Nothing can be buffered yet at construction time, so the first tick is one interval out. When
+            // re-arming, keep the current phase unless the new interval comes due sooner.
+            SInt64 nowMicros = [LSClockState nowMicros];
+            SInt64 firstMicros = nowMicros + (SInt64)flushIntervalSeconds * USEC_PER_SEC;
+            if (self.nextFlushMicros > nowMicros) {
+                firstMicros = MIN(firstMicros, self.nextFlushMicros);
+            }
+            self.nextFlushMicros = firstMicros;
+            UInt64 intervalNanos = flushIntervalSeconds * NSEC_PER_SEC;
+            dispatch_source_set_timer(self.flushTimer,
+                                      dispatch_time(DISPATCH_TIME_NOW, (firstMicros - nowMicros) * NSEC_PER_USEC),
+                                      intervalNanos, NSEC_PER_SEC);
         }
-        dispatch_source_set_timer(self.flushTimer, DISPATCH_TIME_NOW, flushIntervalSeconds * NSEC_PER_SEC,
-                                  NSEC_PER_SEC);
-        __weak __typeof(self) weakSelf = self;
-        dispatch_source_set_event_handler(self.flushTimer, ^{
-            [weakSelf flush:nil];
-        });
-        dispatch_resume(self.flushTimer);
     }
 }
 
+- (void)_flushTimerFired {
+    @synchronized(self) {
+        self.nextFlushMicros = [LSClockState nowMicros] + (SInt64)self.flushIntervalSeconds * USEC_PER_SEC;
+    }
+    [self flush:nil];
+}
+
 - (void)flush:(void (^)(NSError *_Nullable error))doneCallback {
+    [self _flushWithCompletion:^(NSUInteger reportedSpans, NSError *_Nullable error) {
+        if (doneCallback) {
+            doneCallback(error);
+        }
+    }];
+}
+
+- (NSUInteger)drainWithTimeout:(NSTimeInterval)timeout {
+    dispatch_time_t deadline = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(MAX(timeout, 0) * NSEC_PER_SEC));
+    NSUInteger reportedBefore = self.reportedSpanCount;
+    // The flush enters inflightGroup before returning, so the wait below covers it as well as any report that was
+    // already in flight.
+    [self _flushWithCompletion:nil];
+    dispatch_group_wait(self.inflightGroup, deadline);
+    return self.reportedSpanCount - reportedBefore;
+}
+
+- (NSUInteger)shutdownWithTimeout:(NSTimeInterval)timeout {
+    @synchronized(self) {
+        self.isShutdown = true;
+        if (self.flushTimer != nil) {
+            dispatch_source_cancel(self.flushTimer);
+            self.flushTimer = nil;
+        }
+    }
+    // From here on, spans that finish are dropped rather than buffered for a flush that will never come. Traces
+    // still waiting on unfinished spans will not complete now; judge them on what they have.
+    for (NSDictionary *retainedJSON in [self.traceAssembler evictAllTraces]) {
+        [self _bufferSpanJSON:retainedJSON evenIfShutdown:true];
+    }
+    NSUInteger reportedSpans = [self drainWithTimeout:timeout];
+    self.enabled = false;
+    return reportedSpans;
+}
+
+- (void)_flushWithCompletion:(nullable void (^)(NSUInteger reportedSpans, NSError *_Nullable error))completion {
     if (!self.enabled) {
         // Short-circuit.
+        if (completion) {
+            completion(0, nil);
+        }
         return;
     }
-    
+    // A flush that beats the deferred initialization does the work itself, but before taking the lock below, which
+    // every finishing span contends for.
+    [self _finishDeferredInitialization];
+
     // We really want this flush to go through, even if the app enters the
     // background and iOS wants to move on with its life.
     //
@@ -303,117 +640,168 @@ static NSString *kBasicTracerBaggagePrefix = @"ot-baggage-";
     // extant at any given moment, and thus it's safe to store the background
     // task id in _bgTaskId.
     __weak __typeof(self) weakSelf = self;
-    #if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR || TARGET_OS_TV)
-    void (^cleanupBlock)(BOOL, NSError *_Nullable) = ^(BOOL endBackgroundTask, NSError *_Nullable error) {
+    dispatch_group_t inflightGroup = self.inflightGroup;
+    // The background task expiration handler and the request completion can race; only the first one counts.
+    NSObject *cleanupLock = [[NSObject alloc] init];
+    __block BOOL cleanedUp = false;
+    __block NSUInteger spanCount = 0;
+    void (^cleanupBlock)(BOOL, BOOL, NSError *_Nullable) = ^(BOOL endBackgroundTask, BOOL delivered,
+                                                             NSError *_Nullable error) {
+        @synchronized(cleanupLock) {
+            if (cleanedUp) {
+                return;
+            }
+            cleanedUp = true;
+        }
         if (endBackgroundTask) {
             [weakSelf _endBackgroundTask];
         }
-        if (doneCallback) {
-            doneCallback(error);
+        NSUInteger reportedSpans = delivered ? spanCount : 0;
+        [weakSelf _addReportedSpans:reportedSpans];
+        if (completion) {
+            completion(reportedSpans, error);
         }
+        dispatch_group_leave(inflightGroup);
     };
-    #endif
 
+    // Traces that never completed locally still get a chance to be reported once they expire.
+    for (NSDictionary *retainedJSON in [self.traceAssembler evictExpiredTraces]) {
+        [self _bufferSpanJSON:retainedJSON];
+    }
+
+    // Callbacks run user code, so they are only made after leaving the lock below; a callback that waits on a
+    // thread finishing a span would otherwise deadlock.
     NSMutableDictionary *reqJSON;
+    BOOL nothingToReport = false;
+    BOOL backgroundTaskUnavailable = false;
     @synchronized(self) {
         NSDate *now = [NSDate date];
-        if (self.pendingJSONSpans.count == 0) {
-            // Nothing to report.
-            return;
+        nothingToReport = self.pendingSpans.count == 0;
+        if (!nothingToReport) {
+            // reqJSON spec:
+            // https://github.com/lightstep/lightstep-tracer-go/blob/40cbd138e6901f0dafdd0cccabb6fc7c5a716efb/lightstep_thrift/ttypes.go#L2586
+            reqJSON = [NSMutableDictionary dictionary];
+            reqJSON[@"timestamp_offset_micros"] = @(self.clockState.offsetMicros);
+            reqJSON[@"runtime"] = self.tracerJSON;
+            spanCount = self.pendingSpans.count;
+            reqJSON[@"span_records"] = [self.pendingSpans takeAll];
+            reqJSON[@"oldest_micros"] = @([self.lastFlush toMicros]);
+            reqJSON[@"youngest_micros"] = @([now toMicros]);
+
+            self.lastFlush = now;
+            dispatch_group_enter(inflightGroup);
+            #if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR || TARGET_OS_TV)
+                self.bgTaskId = [[UIApplication sharedApplication]
+                    beginBackgroundTaskWithName:@"com.lightstep.flush"
+                              expirationHandler:^{
+                                  cleanupBlock(true, false, [NSError errorWithDomain:LSErrorDomain
+                                                                                code:LSBackgroundTaskError
+                                                                            userInfo:nil]);
+                              }];
+                backgroundTaskUnavailable = self.bgTaskId == UIBackgroundTaskInvalid;
+            #endif
         }
-
-        // reqJSON spec:
-        // https://github.com/lightstep/lightstep-tracer-go/blob/40cbd138e6901f0dafdd0cccabb6fc7c5a716efb/lightstep_thrift/ttypes.go#L2586
-        reqJSON = [NSMutableDictionary dictionary];
-        reqJSON[@"timestamp_offset_micros"] = @(self.clockState.offsetMicros);
-        reqJSON[@"runtime"] = self.tracerJSON;
-        reqJSON[@"span_records"] = self.pendingJSONSpans;
-        reqJSON[@"oldest_micros"] = @([self.lastFlush toMicros]);
-        reqJSON[@"youngest_micros"] = @([now toMicros]);
-
-        self.pendingJSONSpans = [NSMutableArray<NSDictionary *> new];
-        self.lastFlush = now;
-        #if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR || TARGET_OS_TV)
-            self.bgTaskId = [[UIApplication sharedApplication]
-                beginBackgroundTaskWithName:@"com.lightstep.flush"
-                          expirationHandler:^{
-                              cleanupBlock(true,
-                                           [NSError errorWithDomain:LSErrorDomain code:LSBackgroundTaskError userInfo:nil]);
-                          }];
-            if (self.bgTaskId == UIBackgroundTaskInvalid) {
-                NSLog(@"unable to enter the background, so skipping flush");
-                cleanupBlock(false, [NSError errorWithDomain:LSErrorDomain code:LSBackgroundTaskError userInfo:nil]);
-                return;
+    }
+    if (nothingToReport) {
+        if (completion) {
+            completion(0, nil);
         }
-        #endif
+        return;
+    }
+    if (backgroundTaskUnavailable) {
+        NSLog(@"unable to enter the background, so skipping flush");
+        cleanupBlock(false, false, [NSError errorWithDomain:LSErrorDomain code:LSBackgroundTaskError userInfo:nil]);
+        return;
     }
 
-    NSString *reqBody = [LSUtil objectToJSONString:reqJSON maxLength:LSMaxRequestSize];
+    NSData *reqBody = [LSUtil objectToJSONData:reqJSON maxLength:LSMaxRequestSize];
     if (reqBody == nil) {
-        #if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR || TARGET_OS_TV)
-        cleanupBlock(true, [NSError errorWithDomain:LSErrorDomain code:LSRequestTooLargeError userInfo:nil]);
-#endif
+        cleanupBlock(true, false, [NSError errorWithDomain:LSErrorDomain code:LSRequestTooLargeError userInfo:nil]);
         return;
     }
 
-    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:self.baseURL];
-    request.allHTTPHeaderFields = @{
-        @"Content-Type": @"application/json",
-        @"LightStep-Access-Token": self.accessToken
-    };
-    request.HTTPBody = [reqBody dataUsingEncoding:NSUTF8StringEncoding];
-    request.HTTPMethod = @"POST";
-
     SInt64 originMicros = [LSClockState nowMicros];
-    NSURLSessionDataTask *postDataTask =
-        [self.urlSession dataTaskWithRequest:request
-                           completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
-
-            if (error != nil || data == nil) {
-                #if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR || TARGET_OS_TV)
-                cleanupBlock(true, error);
-#endif
-                return;
-            }
-            
-            __typeof(self) strongSelf = weakSelf;
-            SInt64 destinationMicros = [LSClockState nowMicros];
-            NSError *jsonError;
-            NSDictionary *responseJSON = [NSJSONSerialization JSONObjectWithData:data
-                                                                         options:kNilOptions
-                                                                           error:&jsonError];
-            if (jsonError == nil) {
-               if ([responseJSON objectForKey:@"timing"] != nil) {
-                   NSDictionary *timingJSON = [responseJSON objectForKey:@"timing"];
-                   NSNumber *receiveMicros = [timingJSON objectForKey:@"receive_micros"];
-                   NSNumber *transmitMicros = [timingJSON objectForKey:@"transmit_micros"];
-
-                   if (receiveMicros != nil && transmitMicros != nil) {
-                       // Update our local NTP-lite clock state with the latest
-                       // measurements.
-                       [strongSelf.clockState addSampleWithOriginMicros:originMicros
-                                                          receiveMicros:receiveMicros.longLongValue
-                                                         transmitMicros:transmitMicros.longLongValue
-                                                      destinationMicros:destinationMicros];
-                   }
-               }
+    [self.transport sendReport:reqBody
+                   accessToken:self.accessToken
+                    completion:^(BOOL delivered, NSDictionary *_Nullable responseJSON, NSError *_Nullable error) {
+        __typeof(self) strongSelf = weakSelf;
+        SInt64 destinationMicros = [LSClockState nowMicros];
+        if ([responseJSON objectForKey:@"timing"] != nil) {
+            NSDictionary *timingJSON = [responseJSON objectForKey:@"timing"];
+            NSNumber *receiveMicros = [timingJSON objectForKey:@"receive_micros"];
+            NSNumber *transmitMicros = [timingJSON objectForKey:@"transmit_micros"];
+
+            if (receiveMicros != nil && transmitMicros != nil) {
+                // Update our local NTP-lite clock state with the latest
+                // measurements.
+                [strongSelf.clockState addSampleWithOriginMicros:originMicros
+                                                   receiveMicros:receiveMicros.longLongValue
+                                                  transmitMicros:transmitMicros.longLongValue
+                                               destinationMicros:destinationMicros];
             }
-#if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR || TARGET_OS_TV)
-            cleanupBlock(true, jsonError);
-#endif
-        }];
-    // "Start" (resume) the HTTP activity.
-    [postDataTask resume];
+        }
+        cleanupBlock(true, delivered, error);
+    }];
 }
 
-- (NSURLSession *)urlSession {
-    if (_urlSession) {
-        return _urlSession;
+- (void)_addReportedSpans:(NSUInteger)count {
+    @synchronized(self) {
+        self.reportedSpanCount += count;
+    }
+}
+
+- (void)_finishDeferredInitialization {
+    [self clockState];
+    [self tracerJSON];
+}
+
+- (LSClockState *)clockState {
+    @synchronized(self) {
+        if (_clockState == nil) {
+            // Restores persisted samples from NSUserDefaults.
+            _clockState = [[LSClockState alloc] init];
+        }
+        return _clockState;
+    }
+}
+
+- (NSDictionary<NSString *, id> *)tracerJSON {
+    @synchronized(self) {
+        if (_tracerJSON == nil) {
+            _tracerJSON = @{
+                @"guid": [LSUtil hexGUID:self.runtimeGuid],
+                @"attrs": [LSUtil keyValueArrayFromDictionary:@{
+                    @"lightstep.tracer_platform": [LSUtil getTracerPlatform],
+                    @"lightstep.tracer_platform_version": [LSUtil getTracerPlatformVersion],
+                    @"lightstep.tracer_version": LS_TRACER_VERSION,
+                    @"lightstep.component_name": self.componentName ?: @"",
+                    @"device_model": [LSUtil getDeviceModel]
+                }]
+            };
+        }
+        return _tracerJSON;
+    }
+}
+
+- (id<LSTransport>)transport {
+    @synchronized(self) {
+        return _transport;
     }
+}
+
+- (void)setTransport:(id<LSTransport>)transport {
+    @synchronized(self) {
+        // A report handed to no transport would never complete, leaving drains to wait out their timeouts.
+        _transport = transport ?: self.httpTransport;
+    }
+}
+
+- (NSURLSession *)urlSession {
+    return self.httpTransport.urlSession;
+}
 
-    _urlSession = [NSURLSession sessionWithConfiguration:
-                   [NSURLSessionConfiguration defaultSessionConfiguration]];
-    return _urlSession;
+- (void)setUrlSession:(NSURLSession *)urlSession {
+    self.httpTransport.urlSession = urlSession;
 }
 
 // Called by flush() callbacks on a failed report.
@@ -0,0 +1,27 @@
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Called once a report has been sent, or has failed to send.
+///
+/// @param delivered true if the receiver accepted the report
+/// @param responseJSON the receiver's decoded response, if it sent one; used for clock synchronization
+/// @param error the reason the report was not delivered, or a problem with the response
+typedef void (^LSTransportCompletion)(BOOL delivered,
+                                      NSDictionary *_Nullable responseJSON,
+                                      NSError *_Nullable error);
+
+/// The means by which an `LSTracer` delivers encoded reports.
+///
+/// @see LSHTTPTransport, LSUnixSocketTransport
+@protocol LSTransport<NSObject>
+
+/// Send one report. Must not block the calling thread, and must call `completion` exactly once, on any thread.
+///
+/// @param report the report, already encoded as UTF-8 JSON
+/// @param accessToken the tracer's access token
+- (void)sendReport:(NSData *)report accessToken:(NSString *)accessToken completion:(LSTransportCompletion)completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,27 @@
+#import <Foundation/Foundation.h>
+
+#import "LSTransport.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Reports to a forwarding agent on the same host over a Unix domain stream socket, avoiding TLS and HTTP framing.
+///
+/// Each report is written as two frames, the access token followed by the JSON report. Each frame is a 4-byte
+/// big-endian length followed by that many bytes. Both frames go out in a single `writev` straight from the
+/// encoder's buffers, without being copied into a send buffer. A report counts as delivered once it has been
+/// written in full. The agent sends no response.
+///
+/// The socket is connected on first use, and again after any failed write.
+///
+/// LSUnixSocketTransport is thread-safe.
+@interface LSUnixSocketTransport : NSObject<LSTransport>
+
+/// @param path the agent's socket path; at most 103 bytes
+- (instancetype)initWithPath:(NSString *)path;
+
+/// The agent's socket path.
+@property(nonatomic, copy, readonly) NSString *path;
+
+@end
+
+NS_ASSUME_NONNULL_END
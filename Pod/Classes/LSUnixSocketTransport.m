@@ -0,0 +1,129 @@
+#import "LSUnixSocketTransport.h"
+
+#import <arpa/inet.h>
+#import <sys/socket.h>
+#import <sys/uio.h>
+#import <sys/un.h>
+#import <unistd.h>
+
+// Bounds how long a flush can be held up by an agent that has stopped reading.
+static const struct timeval LSUnixSocketSendTimeout = {5, 0};
+
+static NSError *LSPOSIXError(int code) {
+    return [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil];
+}
+
+// Writes every buffer in full, resuming after partial writes. Modifies `iov`.
+static NSError *LSWriteFully(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return LSPOSIXError(errno);
+        }
+        // Skip the buffers that went out completely, then advance into a partially-written one.
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return nil;
+}
+
+@interface LSUnixSocketTransport ()
+@property(nonatomic, strong, readonly) dispatch_queue_t queue;
+// Only used on `queue`; -1 while disconnected.
+@property(nonatomic) int socketFD;
+@end
+
+@implementation LSUnixSocketTransport
+
+- (instancetype)initWithPath:(NSString *)path {
+    if (self = [super init]) {
+        _path = [path copy];
+        _queue = dispatch_queue_create("com.lightstep.unix_socket_transport", DISPATCH_QUEUE_SERIAL);
+        _socketFD = -1;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_socketFD >= 0) {
+        close(_socketFD);
+    }
+}
+
+- (void)sendReport:(NSData *)report accessToken:(NSString *)accessToken completion:(LSTransportCompletion)completion {
+    dispatch_async(self.queue, ^{
+        NSError *error = [self _writeReport:report accessToken:accessToken];
+        completion(error == nil, nil, error);
+    });
+}
+
+#pragma mark - Private
+
+// Must be called on `queue`.
+- (NSError *)_writeReport:(NSData *)report accessToken:(NSString *)accessToken {
+    if (self.socketFD < 0) {
+        NSError *error = [self _connect];
+        if (error != nil) {
+            return error;
+        }
+    }
+
+    NSData *token = [accessToken dataUsingEncoding:NSUTF8StringEncoding];
+    uint32_t tokenLength = htonl((uint32_t)token.length);
+    uint32_t reportLength = htonl((uint32_t)report.length);
+    struct iovec iov[] = {
+        {&tokenLength, sizeof(tokenLength)},
+        {(void *)token.bytes, token.length},
+        {&reportLength, sizeof(reportLength)},
+        {(void *)report.bytes, report.length},
+    };
+    NSError *error = LSWriteFully(self.socketFD, iov, sizeof(iov) / sizeof(iov[0]));
+    if (error != nil) {
+        // The stream may now be out of frame; start over on a fresh connection next time.
+        close(self.socketFD);
+        self.socketFD = -1;
+    }
+    return error;
+}
+
+// Must be called on `queue`.
+- (NSError *)_connect {
+    const char *path = self.path.fileSystemRepresentation;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return LSPOSIXError(ENAMETOOLONG);
+    }
+    strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return LSPOSIXError(errno);
+    }
+    #ifdef SO_NOSIGPIPE
+    // An agent that goes away must surface as EPIPE rather than terminate the process.
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    #endif
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &LSUnixSocketSendTimeout, sizeof(LSUnixSocketSendTimeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        NSError *error = LSPOSIXError(errno);
+        close(fd);
+        return error;
+    }
+    self.socketFD = fd;
+    return nil;
+}
+
+@end
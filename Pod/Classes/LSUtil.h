@@ -11,7 +11,26 @@ NS_ASSUME_NONNULL_BEGIN
 + (NSString *)hexGUID:(UInt64)guid;
 + (UInt64)guidFromHex:(NSString *)hexString;
 + (NSString *)objectToJSONString:(nullable id)obj maxLength:(NSUInteger)maxLength;
+
+/// Encodes a dictionary or array as UTF-8 JSON, handing back the encoder's buffer without converting it to a string.
+///
+/// @returns nil if `obj` is not a valid JSON object or encodes to more than `maxLength` bytes.
++ (nullable NSData *)objectToJSONData:(nullable id)obj maxLength:(NSUInteger)maxLength;
+
+/// Encodes `obj` as JSON of at most `maxLength` UTF-8 bytes. Unlike `objectToJSONString:maxLength:`, an oversized
+/// object is not serialized in full and then dropped: encoding stops once the budget is used up, and the result is
+/// still valid JSON with a "[truncated]" marker where the rest was cut. Non-string dictionary keys are encoded by
+/// their description.
+///
+/// @returns nil only if `obj` is nil or `maxLength` is too small to hold the truncation marker.
++ (nullable NSString *)objectToTruncatedJSONString:(nullable id)obj maxLength:(NSUInteger)maxLength;
 + (NSMutableArray *)keyValueArrayFromDictionary:(NSDictionary<NSString *, NSObject *> *)dict;
++ (BOOL)spanJSONHasErrorTag:(NSDictionary *)spanJSON;
+/// @returns true if the span record has no parent_span_guid attribute.
++ (BOOL)spanJSONIsRoot:(NSDictionary *)spanJSON;
+/// A cheap estimate, without encoding anything, of the length of `obj` as JSON. String lengths are counted in
+/// UTF-16 code units, so the estimate is exact for ASCII and low for other text.
++ (NSUInteger)estimatedJSONLengthOfObject:(nullable id)obj;
 + (NSString *)getTracerPlatform;
 + (NSString *)getTracerPlatformVersion;
 + (NSString *)getDeviceModel;
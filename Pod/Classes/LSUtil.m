@@ -6,6 +6,250 @@
 #import <UIKit/UIKit.h>
 #endif
 
+#pragma mark - LSBudgetedJSONWriter
+
+static const char LSJSONTruncationMarker[] = "[truncated]";
+// The most bytes any truncation marker can add beyond the limit of the value it replaces: the object form
+// `,"[truncated]":true`. Everything else (in-string suffix, array element) is shorter.
+static const NSUInteger LSJSONTruncationReserve = 19;
+static const NSUInteger LSJSONStringChunkLength = 1024;
+
+typedef NS_ENUM(NSInteger, LSJSONWriteResult) {
+    // The value was written in full.
+    LSJSONWriteOK,
+    // The value did not fit and nothing usable was written; the caller must roll back and emit a marker.
+    LSJSONWriteOverflow,
+    // The value was cut short and already carries a marker; the caller must stop and close its containers.
+    LSJSONWriteTruncated,
+};
+
+/// Walks an object graph writing JSON until a byte budget is used up. Every write is checked against a limit before
+/// it happens, so the cost of encoding is proportional to the budget rather than the size of the object.
+///
+/// Containers reserve a byte for their closing bracket, and one marker's worth of bytes is reserved globally, so a
+/// truncated result is always valid JSON no longer than the budget.
+@interface LSBudgetedJSONWriter : NSObject
+@property(nonatomic, strong, readonly) NSMutableData *output;
+@end
+
+@implementation LSBudgetedJSONWriter
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    if (self = [super init]) {
+        _output = [NSMutableData dataWithCapacity:MIN(capacity, 4096)];
+    }
+    return self;
+}
+
+- (void)appendCString:(const char *)str {
+    [self.output appendBytes:str length:strlen(str)];
+}
+
+- (LSJSONWriteResult)writeValue:(id)obj limit:(NSUInteger)limit {
+    if (self.output.length >= limit) {
+        return LSJSONWriteOverflow;
+    }
+    if (obj == nil || obj == [NSNull null]) {
+        return [self writeLiteral:"null" limit:limit];
+    } else if ([obj isKindOfClass:[NSString class]]) {
+        return [self writeString:obj limit:limit allowPartial:true];
+    } else if ([obj isKindOfClass:[NSNumber class]]) {
+        return [self writeNumber:obj limit:limit];
+    } else if ([obj isKindOfClass:[NSDictionary class]]) {
+        return [self writeDictionary:obj limit:limit];
+    } else if ([obj isKindOfClass:[NSArray class]]) {
+        return [self writeArray:obj limit:limit];
+    }
+    // Anything NSJSONSerialization would reject is encoded by its description.
+    return [self writeString:[obj description] limit:limit allowPartial:true];
+}
+
+- (LSJSONWriteResult)writeLiteral:(const char *)literal limit:(NSUInteger)limit {
+    size_t length = strlen(literal);
+    if (self.output.length + length > limit) {
+        return LSJSONWriteOverflow;
+    }
+    [self.output appendBytes:literal length:length];
+    return LSJSONWriteOK;
+}
+
+- (LSJSONWriteResult)writeNumber:(NSNumber *)number limit:(NSUInteger)limit {
+    if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID()) {
+        return [self writeLiteral:(number.boolValue ? "true" : "false") limit:limit];
+    }
+    char buf[32];
+    switch (number.objCType[0]) {
+        case 'f':
+        case 'd': {
+            double value = number.doubleValue;
+            if (!isfinite(value)) {
+                return [self writeLiteral:"null" limit:limit];
+            }
+            // Matches NSJSONSerialization's round-trippable precision.
+            snprintf(buf, sizeof(buf), "%.17g", value);
+            break;
+        }
+        case 'Q':
+        case 'L':
+        case 'I':
+        case 'S':
+        case 'C':
+            snprintf(buf, sizeof(buf), "%llu", number.unsignedLongLongValue);
+            break;
+        default:
+            snprintf(buf, sizeof(buf), "%lld", number.longLongValue);
+            break;
+    }
+    return [self writeLiteral:buf limit:limit];
+}
+
+// Writes a quoted, escaped string. If it does not fit and `allowPartial` is set, as much as fits is kept and the
+// string ends with the truncation marker; otherwise the caller is told to roll back.
+- (LSJSONWriteResult)writeString:(NSString *)string limit:(NSUInteger)limit allowPartial:(BOOL)allowPartial {
+    NSMutableData *output = self.output;
+    if (output.length + 2 > limit) {
+        return LSJSONWriteOverflow;
+    }
+    [output appendBytes:"\"" length:1];
+
+    // Convert the string a chunk at a time: only the prefix that can possibly fit is ever transcoded.
+    uint8_t chunk[LSJSONStringChunkLength];
+    uint8_t escaped[LSJSONStringChunkLength * 6];
+    NSRange remaining = NSMakeRange(0, string.length);
+    while (remaining.length > 0) {
+        NSUInteger used = 0;
+        [string getBytes:chunk
+                 maxLength:sizeof(chunk)
+                usedLength:&used
+                  encoding:NSUTF8StringEncoding
+                   options:NSStringEncodingConversionAllowLossy
+                     range:remaining
+            remainingRange:&remaining];
+        if (used == 0) {
+            break;
+        }
+
+        // Leave room for the closing quote.
+        NSUInteger available = limit > output.length + 1 ? limit - output.length - 1 : 0;
+        NSUInteger n = 0;
+        BOOL full = false;
+        for (NSUInteger i = 0; i < used;) {
+            uint8_t c = chunk[i];
+            char seq[8];
+            NSUInteger seqLength = 0;
+            NSUInteger consumed = 1;
+            if (c == '"' || c == '\\') {
+                seq[0] = '\\';
+                seq[1] = (char)c;
+                seqLength = 2;
+            } else if (c < 0x20) {
+                switch (c) {
+                    case '\n': memcpy(seq, "\\n", 2); seqLength = 2; break;
+                    case '\r': memcpy(seq, "\\r", 2); seqLength = 2; break;
+                    case '\t': memcpy(seq, "\\t", 2); seqLength = 2; break;
+                    case '\b': memcpy(seq, "\\b", 2); seqLength = 2; break;
+                    case '\f': memcpy(seq, "\\f", 2); seqLength = 2; break;
+                    default: seqLength = (NSUInteger)snprintf(seq, sizeof(seq), "\\u%04x", c); break;
+                }
+            } else {
+                // Copy multi-byte UTF-8 sequences whole so a cut never splits a character.
+                consumed = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+                consumed = MIN(consumed, used - i);
+                memcpy(seq, &chunk[i], consumed);
+                seqLength = consumed;
+            }
+            if (n + seqLength > available) {
+                full = true;
+                break;
+            }
+            memcpy(&escaped[n], seq, seqLength);
+            n += seqLength;
+            i += consumed;
+        }
+        [output appendBytes:escaped length:n];
+        if (full) {
+            if (!allowPartial) {
+                return LSJSONWriteOverflow;
+            }
+            [self appendCString:LSJSONTruncationMarker];
+            [output appendBytes:"\"" length:1];
+            return LSJSONWriteTruncated;
+        }
+    }
+    [output appendBytes:"\"" length:1];
+    return LSJSONWriteOK;
+}
+
+- (LSJSONWriteResult)writeArray:(NSArray *)array limit:(NSUInteger)limit {
+    NSMutableData *output = self.output;
+    if (output.length + 2 > limit) {
+        return LSJSONWriteOverflow;
+    }
+    [output appendBytes:"[" length:1];
+    NSUInteger innerLimit = limit - 1; // reserve "]"
+    BOOL first = true;
+    for (id element in array) {
+        NSUInteger mark = output.length;
+        if (!first) {
+            [output appendBytes:"," length:1];
+        }
+        LSJSONWriteResult result = [self writeValue:element limit:innerLimit];
+        if (result == LSJSONWriteOverflow) {
+            output.length = mark;
+            [self appendCString:(first ? "\"" : ",\"")];
+            [self appendCString:LSJSONTruncationMarker];
+            [output appendBytes:"\"]" length:2];
+            return LSJSONWriteTruncated;
+        }
+        if (result == LSJSONWriteTruncated) {
+            [output appendBytes:"]" length:1];
+            return LSJSONWriteTruncated;
+        }
+        first = false;
+    }
+    [output appendBytes:"]" length:1];
+    return LSJSONWriteOK;
+}
+
+- (LSJSONWriteResult)writeDictionary:(NSDictionary *)dict limit:(NSUInteger)limit {
+    NSMutableData *output = self.output;
+    if (output.length + 2 > limit) {
+        return LSJSONWriteOverflow;
+    }
+    [output appendBytes:"{" length:1];
+    NSUInteger innerLimit = limit - 1; // reserve "}"
+    BOOL first = true;
+    for (id key in dict) {
+        NSUInteger mark = output.length;
+        if (!first) {
+            [output appendBytes:"," length:1];
+        }
+        // NSJSONSerialization rejects non-string keys outright; use their description instead.
+        NSString *keyString = [key isKindOfClass:[NSString class]] ? key : [key description];
+        LSJSONWriteResult result = [self writeString:keyString limit:innerLimit allowPartial:false];
+        if (result == LSJSONWriteOK) {
+            [output appendBytes:":" length:1];
+            result = [self writeValue:dict[key] limit:innerLimit];
+        }
+        if (result == LSJSONWriteOverflow) {
+            output.length = mark;
+            [self appendCString:(first ? "\"" : ",\"")];
+            [self appendCString:LSJSONTruncationMarker];
+            [output appendBytes:"\":true}" length:7];
+            return LSJSONWriteTruncated;
+        }
+        if (result == LSJSONWriteTruncated) {
+            [output appendBytes:"}" length:1];
+            return LSJSONWriteTruncated;
+        }
+        first = false;
+    }
+    [output appendBytes:"}" length:1];
+    return LSJSONWriteOK;
+}
+
+@end
+
 @implementation LSUtil
 
 + (UInt64)generateGUID {
@@ -34,6 +278,44 @@
     return json;
 }
 
++ (NSData *)objectToJSONData:(id)obj maxLength:(NSUInteger)maxLength {
+    if (obj == nil) {
+        return nil;
+    }
+    NSError *error;
+    NSData *jsonData;
+    @try {
+        jsonData = [NSJSONSerialization dataWithJSONObject:obj options:0 error:&error];
+    } @catch (NSException *e) {
+        NSLog(@"Invalid object for JSON conversion");
+        return nil;
+    }
+    if (!jsonData) {
+        NSLog(@"Could not encode JSON: %@", error);
+        return nil;
+    }
+    if (jsonData.length > maxLength) {
+        NSLog(@"Dropping excessively large payload: length=%@", @(jsonData.length));
+        return nil;
+    }
+    return jsonData;
+}
+
++ (NSString *)objectToTruncatedJSONString:(id)obj maxLength:(NSUInteger)maxLength {
+    if (obj == nil || maxLength <= LSJSONTruncationReserve) {
+        return nil;
+    }
+    LSBudgetedJSONWriter *writer = [[LSBudgetedJSONWriter alloc] initWithCapacity:maxLength];
+    if ([writer writeValue:obj limit:maxLength - LSJSONTruncationReserve] == LSJSONWriteOverflow) {
+        // Only possible for a top-level scalar or a container too small to even open.
+        writer.output.length = 0;
+        [writer appendCString:"\""];
+        [writer appendCString:LSJSONTruncationMarker];
+        [writer appendCString:"\""];
+    }
+    return [[NSString alloc] initWithData:writer.output encoding:NSUTF8StringEncoding];
+}
+
 + (NSString *)getTracerPlatform {
     #if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR || TARGET_OS_TV)
         return @"ios";
@@ -91,16 +373,8 @@
 }
 
 + (NSString *)serializeToJSON:(NSDictionary *)dict {
-    NSError *error;
-    NSData *jsonData;
-    @try {
-        jsonData = [NSJSONSerialization dataWithJSONObject:dict options:0 error:&error];
-    } @catch (NSException *e) {
-        NSLog(@"Invalid object for JSON conversation");
-        return nil;
-    }
-    if (!jsonData) {
-        NSLog(@"Could not encode JSON: %@", error);
+    NSData *jsonData = [LSUtil objectToJSONData:dict maxLength:NSUIntegerMax];
+    if (jsonData == nil) {
         return nil;
     }
     return [[NSString alloc] initWithData:jsonData encoding:NSUTF8StringEncoding];
@@ -115,6 +389,52 @@
     return rval;
 }
 
++ (BOOL)spanJSONHasErrorTag:(NSDictionary *)spanJSON {
+    for (NSDictionary *keyValuePair in spanJSON[@"attributes"]) {
+        // Keys are whatever the caller tagged with, and need not be strings.
+        if ([keyValuePair[@"Key"] isEqual:@"error"]) {
+            // Tag values are recorded via -description, so @YES arrives as "1".
+            NSString *value = keyValuePair[@"Value"];
+            return [value isEqualToString:@"1"] || [value caseInsensitiveCompare:@"true"] == NSOrderedSame;
+        }
+    }
+    return false;
+}
+
++ (BOOL)spanJSONIsRoot:(NSDictionary *)spanJSON {
+    for (NSDictionary *keyValuePair in spanJSON[@"attributes"]) {
+        if ([keyValuePair[@"Key"] isEqual:@"parent_span_guid"]) {
+            return false;
+        }
+    }
+    return true;
+}
+
++ (NSUInteger)estimatedJSONLengthOfObject:(id)obj {
+    if ([obj isKindOfClass:[NSString class]]) {
+        return [(NSString *)obj length] + 2;
+    } else if ([obj isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dict = obj;
+        // Braces, and a colon and comma per entry.
+        NSUInteger length = 2 + dict.count * 2;
+        for (id key in dict) {
+            length += [LSUtil estimatedJSONLengthOfObject:key] + [LSUtil estimatedJSONLengthOfObject:dict[key]];
+        }
+        return length;
+    } else if ([obj isKindOfClass:[NSArray class]]) {
+        NSArray *array = obj;
+        NSUInteger length = 2 + array.count;
+        for (id element in array) {
+            length += [LSUtil estimatedJSONLengthOfObject:element];
+        }
+        return length;
+    } else if ([obj isKindOfClass:[NSNumber class]]) {
+        // Long enough for any 64-bit integer; micros timestamps are the common case.
+        return 20;
+    }
+    return 4; // null
+}
+
 @end
 
 @implementation NSDate (LSSpan)
@@ -7,9 +7,15 @@
 #define LightStep_Bridging_Header_h
 
 #import "LSClockState.h"
+#import "LSHTTPTransport.h"
+#import "LSScope.h"
 #import "LSSpan.h"
 #import "LSSpanContext.h"
+#import "LSStringInterner.h"
+#import "LSTraceAssembler.h"
 #import "LSTracer.h"
+#import "LSTransport.h"
+#import "LSUnixSocketTransport.h"
 #import "LSUtil.h"
 #import "LSVersion.h"
 
@@ -1,13 +1,246 @@
 #import <XCTest/XCTest.h>
+#import <arpa/inet.h>
+#import <netinet/in.h>
+#import <sys/socket.h>
+#import <sys/un.h>
 
+#import <lightstep/LSHTTPTransport.h>
+#import <lightstep/LSScope.h>
 #import <lightstep/LSSpan.h>
+#import <lightstep/LSSpanContext.h>
+#import <lightstep/LSStringInterner.h>
+#import <lightstep/LSTraceAssembler.h>
 #import <lightstep/LSTracer.h>
+#import <lightstep/LSUnixSocketTransport.h>
 #import <lightstep/LSUtil.h>
 
 NS_ASSUME_NONNULL_BEGIN
 
 const NSUInteger kMaxLength = 8192;
 
+#pragma mark - LSTestAgent
+
+static BOOL LSReadFully(int fd, void *buffer, size_t length) {
+    while (length > 0) {
+        ssize_t n = read(fd, buffer, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer = (char *)buffer + n;
+        length -= n;
+    }
+    return true;
+}
+
+static NSData *_Nullable LSReadFrame(int fd) {
+    uint32_t length;
+    if (!LSReadFully(fd, &length, sizeof(length))) {
+        return nil;
+    }
+    NSMutableData *frame = [NSMutableData dataWithLength:ntohl(length)];
+    return LSReadFully(fd, frame.mutableBytes, frame.length) ? frame : nil;
+}
+
+/// A stand-in for a local forwarding agent or a collector. Reads either the frames written by LSUnixSocketTransport
+/// or plain HTTP/1.1 POSTs, and counts the reports and span records it receives.
+@interface LSTestAgent : NSObject
+- (instancetype)initWithUnixSocketPath:(NSString *)path;
+/// Listens on an ephemeral loopback port; see `url`.
+- (instancetype)initHTTP;
+@property(nonatomic, strong, readonly, nullable) NSURL *url;
+@property(atomic, readonly) NSUInteger reportCount;
+@property(atomic, readonly) NSUInteger spanCount;
+@property(atomic, copy, readonly, nullable) NSString *lastAccessToken;
+/// The span_name of every span record received, in order.
+@property(atomic, copy, readonly) NSArray<NSString *> *operationNames;
+/// Waits until at least `count` span records have arrived.
+- (BOOL)waitForSpanCount:(NSUInteger)count timeout:(NSTimeInterval)timeout;
+/// Stops accepting connections and hangs up on open ones.
+- (void)stop;
+@end
+
+@interface LSTestAgent ()
+@property(nonatomic) BOOL http;
+@property(nonatomic, copy, nullable) NSString *socketPath;
+@property(nonatomic, strong) dispatch_source_t acceptSource;
+@property(nonatomic, strong) NSMutableSet<NSNumber *> *connections;
+@property(atomic, readwrite) NSUInteger reportCount;
+@property(atomic, readwrite) NSUInteger spanCount;
+@property(atomic, copy, readwrite, nullable) NSString *lastAccessToken;
+@property(atomic, copy, readwrite) NSArray<NSString *> *operationNames;
+@end
+
+@implementation LSTestAgent
+
+- (instancetype)initWithUnixSocketPath:(NSString *)path {
+    if (self = [super init]) {
+        _socketPath = [path copy];
+        unlink(path.fileSystemRepresentation);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strlcpy(addr.sun_path, path.fileSystemRepresentation, sizeof(addr.sun_path));
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+        [self _listen:fd];
+    }
+    return self;
+}
+
+- (instancetype)initHTTP {
+    if (self = [super init]) {
+        _http = true;
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+        socklen_t addrLength = sizeof(addr);
+        getsockname(fd, (struct sockaddr *)&addr, &addrLength);
+        _url = [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1:%d/api/v0/reports",
+                                                               ntohs(addr.sin_port)]];
+        [self _listen:fd];
+    }
+    return self;
+}
+
+- (BOOL)waitForSpanCount:(NSUInteger)count timeout:(NSTimeInterval)timeout {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while (self.spanCount < count) {
+        if ([deadline timeIntervalSinceNow] < 0) {
+            return false;
+        }
+        usleep(1000);
+    }
+    return true;
+}
+
+- (void)stop {
+    dispatch_source_cancel(self.acceptSource);
+    @synchronized(self) {
+        for (NSNumber *connection in self.connections) {
+            shutdown(connection.intValue, SHUT_RDWR);
+        }
+    }
+    if (self.socketPath != nil) {
+        unlink(self.socketPath.fileSystemRepresentation);
+    }
+}
+
+- (void)_listen:(int)fd {
+    self.connections = [NSMutableSet set];
+    self.operationNames = @[];
+    listen(fd, 8);
+    dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+    self.acceptSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0, queue);
+    __weak __typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(self.acceptSource, ^{
+        int connection = accept(fd, NULL, NULL);
+        if (connection < 0) {
+            return;
+        }
+        __typeof(self) strongSelf = weakSelf;
+        @synchronized(strongSelf) {
+            [strongSelf.connections addObject:@(connection)];
+        }
+        dispatch_async(queue, ^{
+            if (strongSelf.http) {
+                [strongSelf _serveHTTP:connection];
+            } else {
+                [strongSelf _serveFrames:connection];
+            }
+            @synchronized(strongSelf) {
+                [strongSelf.connections removeObject:@(connection)];
+            }
+            close(connection);
+        });
+    });
+    dispatch_source_set_cancel_handler(self.acceptSource, ^{
+        close(fd);
+    });
+    dispatch_resume(self.acceptSource);
+}
+
+- (void)_serveFrames:(int)fd {
+    while (true) {
+        NSData *token = LSReadFrame(fd);
+        NSData *report = token != nil ? LSReadFrame(fd) : nil;
+        if (report == nil) {
+            return;
+        }
+        [self _receivedReport:report accessToken:[[NSString alloc] initWithData:token encoding:NSUTF8StringEncoding]];
+    }
+}
+
+- (void)_serveHTTP:(int)fd {
+    static const char response[] = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 2\r\n\r\n{}";
+    NSData *separator = [@"\r\n\r\n" dataUsingEncoding:NSASCIIStringEncoding];
+    NSMutableData *pending = [NSMutableData data];
+    char chunk[16 * 1024];
+    while (true) {
+        NSRange headerEnd = [pending rangeOfData:separator options:0 range:NSMakeRange(0, pending.length)];
+        if (headerEnd.location == NSNotFound) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) {
+                return;
+            }
+            [pending appendBytes:chunk length:n];
+            continue;
+        }
+
+        NSString *header = [[NSString alloc] initWithData:[pending subdataWithRange:NSMakeRange(0, headerEnd.location)]
+                                                 encoding:NSASCIIStringEncoding];
+        NSUInteger contentLength = 0;
+        NSString *accessToken;
+        for (NSString *line in [header componentsSeparatedByString:@"\r\n"]) {
+            NSRange colon = [line rangeOfString:@":"];
+            if (colon.location == NSNotFound) {
+                continue;
+            }
+            NSString *name = [line substringToIndex:colon.location].lowercaseString;
+            NSString *value = [[line substringFromIndex:colon.location + 1]
+                stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+            if ([name isEqualToString:@"content-length"]) {
+                contentLength = (NSUInteger)value.integerValue;
+            } else if ([name isEqualToString:@"lightstep-access-token"]) {
+                accessToken = value;
+            }
+        }
+
+        NSUInteger bodyStart = NSMaxRange(headerEnd);
+        while (pending.length < bodyStart + contentLength) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) {
+                return;
+            }
+            [pending appendBytes:chunk length:n];
+        }
+        NSData *body = [pending subdataWithRange:NSMakeRange(bodyStart, contentLength)];
+        [pending replaceBytesInRange:NSMakeRange(0, bodyStart + contentLength) withBytes:NULL length:0];
+        [self _receivedReport:body accessToken:accessToken];
+        write(fd, response, sizeof(response) - 1);
+    }
+}
+
+- (void)_receivedReport:(NSData *)report accessToken:(nullable NSString *)accessToken {
+    NSDictionary *reportJSON = [NSJSONSerialization JSONObjectWithData:report options:0 error:nil];
+    @synchronized(self) {
+        self.lastAccessToken = accessToken;
+        self.spanCount += [reportJSON[@"span_records"] count];
+        self.operationNames = [self.operationNames
+            arrayByAddingObjectsFromArray:[reportJSON[@"span_records"] valueForKey:@"span_name"]];
+        self.reportCount++;
+    }
+}
+
+@end
+
+#pragma mark - LightStepUnitTests
+
 @interface LightStepUnitTests : XCTestCase
 @property(nonatomic, strong) LSTracer *tracer;
 @end
@@ -27,6 +260,21 @@ const NSUInteger kMaxLength = 8192;
     [super tearDown];
 }
 
+// Times `iterations` runs of `body`, then `completion` (e.g. to wait for queued work); divide the reported time by
+// `iterations` for the cost of one run.
+- (void)_measureIterations:(int)iterations body:(void (^)(int i))body completion:(nullable dispatch_block_t)completion {
+    [self measureBlock:^{
+        for (int i = 0; i < iterations; i++) {
+            @autoreleasepool {
+                body(i);
+            }
+        }
+        if (completion) {
+            completion();
+        }
+    }];
+}
+
 - (void)testObjectToJSONStringBasics {
     // Null
     XCTAssertEqualObjects([LSUtil objectToJSONString:nil maxLength:kMaxLength], nil);
@@ -75,6 +323,69 @@ const NSUInteger kMaxLength = 8192;
     XCTAssertEqualObjects([LSUtil objectToJSONString:longString maxLength:402], longStringJSON);
 }
 
+- (void)testTruncatedJSONString {
+    // Payloads within budget match NSJSONSerialization.
+    XCTAssertEqualObjects([LSUtil objectToTruncatedJSONString:nil maxLength:kMaxLength], nil);
+    XCTAssertEqualObjects([LSUtil objectToTruncatedJSONString:@"test" maxLength:kMaxLength], @"\"test\"");
+    XCTAssertEqualObjects([LSUtil objectToTruncatedJSONString:@42 maxLength:kMaxLength], @"42");
+    XCTAssertEqualObjects([LSUtil objectToTruncatedJSONString:@3.14 maxLength:kMaxLength], @"3.1400000000000001");
+    XCTAssertEqualObjects([LSUtil objectToTruncatedJSONString:@(true) maxLength:kMaxLength], @"true");
+    XCTAssertEqualObjects([LSUtil objectToTruncatedJSONString:[NSNull null] maxLength:kMaxLength], @"null");
+    NSArray *arr = @[@"te\"st\n", @42, @[], @{}];
+    XCTAssertEqualObjects([LSUtil objectToTruncatedJSONString:arr maxLength:kMaxLength],
+                          @"[\"te\\\"st\\n\",42,[],{}]");
+
+    // Non-string keys are encoded by their description rather than failing.
+    XCTAssertEqualObjects([LSUtil objectToTruncatedJSONString:@{ @1: @"one" } maxLength:kMaxLength],
+                          @"{\"1\":\"one\"}");
+
+    // Oversized strings keep a prefix.
+    NSString *longString = [@"" stringByPaddingToLength:400 withString:@"*" startingAtIndex:0];
+    NSString *truncated = [LSUtil objectToTruncatedJSONString:longString maxLength:100];
+    XCTAssertLessThanOrEqual([truncated lengthOfBytesUsingEncoding:NSUTF8StringEncoding], 100);
+    XCTAssert([truncated hasPrefix:@"\"****"]);
+    XCTAssert([truncated hasSuffix:@"[truncated]\""]);
+
+    // Oversized containers stay valid JSON, and never split multi-byte characters.
+    NSMutableArray *many = [NSMutableArray array];
+    for (int i = 0; i < 1000; i++) {
+        [many addObject:@{ @"index": @(i), @"text": @"h\u00e9llo \u2603" }];
+    }
+    for (NSUInteger budget = 20; budget < 400; budget++) {
+        NSString *json = [LSUtil objectToTruncatedJSONString:@{ @"items": many } maxLength:budget];
+        NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+        XCTAssertNotNil(json);
+        XCTAssertLessThanOrEqual(data.length, budget);
+        XCTAssertNotNil([NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingAllowFragments error:nil],
+                        @"%@", json);
+        XCTAssert([json containsString:@"[truncated]"]);
+    }
+}
+
+- (void)testOversizedPayloadSerializeThenDropPerformance {
+    NSArray *payload = [self _oversizedPayload];
+    [self measureBlock:^{
+        XCTAssertNil([LSUtil objectToJSONString:payload maxLength:kMaxLength]);
+    }];
+}
+
+- (void)testOversizedPayloadTruncatedEncoderPerformance {
+    NSArray *payload = [self _oversizedPayload];
+    [self measureBlock:^{
+        XCTAssertNotNil([LSUtil objectToTruncatedJSONString:payload maxLength:kMaxLength]);
+    }];
+}
+
+// Roughly 5MB of JSON.
+- (NSArray *)_oversizedPayload {
+    NSString *row = [@"" stringByPaddingToLength:1000 withString:@"payload " startingAtIndex:0];
+    NSMutableArray *payload = [NSMutableArray arrayWithCapacity:5000];
+    for (int i = 0; i < 5000; i++) {
+        [payload addObject:@{ @"row": @(i), @"text": row }];
+    }
+    return payload;
+}
+
 - (void)testLSSpan {
     // Test timestamps, span context basics, and operation names.
     LSSpan *parent = (LSSpan *)[self.tracer startSpan:@"parent"];
@@ -159,6 +470,404 @@ const NSUInteger kMaxLength = 8192;
     }
 }
 
+- (void)testStartSpanFastPath {
+    LSSpan *parent = (LSSpan *)[self.tracer startSpan:@"parent"];
+    LSSpan *child = [self.tracer startSpan:@"child" parentContext:parent.context];
+    [child setTag:@"bool" boolValue:true];
+    [child setTag:@"int" integerValue:42];
+    [child setTag:@"double" doubleValue:2.5];
+
+    // Typed tags are reported exactly like their boxed equivalents.
+    LSSpan *boxed = (LSSpan *)[self.tracer startSpan:@"child"
+                                             childOf:parent.context
+                                                tags:@{ @"bool": @(true), @"int": @(42), @"double": @(2.5) }];
+    NSDate *now = [NSDate date];
+    NSDictionary *childJSON = [child _toJSONWithFinishTime:now];
+    NSDictionary *boxedJSON = [boxed _toJSONWithFinishTime:now];
+    XCTAssertEqualObjects(childJSON[@"trace_guid"], [parent _toJSONWithFinishTime:now][@"trace_guid"]);
+    XCTAssertEqualObjects([NSSet setWithArray:childJSON[@"attributes"]], [NSSet setWithArray:boxedJSON[@"attributes"]]);
+
+    LSSpan *root = [self.tracer startSpan:@"root" parentContext:nil];
+    XCTAssertNotEqual(root.context.traceId, parent.context.traceId);
+}
+
+- (void)testStartSpanGenericPathPerformance {
+    LSSpanContext *parent = ((LSSpan *)[self.tracer startSpan:@"parent"]).context;
+    [self _measureIterations:10000
+                        body:^(int i) {
+                            [self.tracer startSpan:@"op" childOf:parent tags:@{ @"int": @(i), @"bool": @(true) }];
+                        }
+                  completion:nil];
+}
+
+- (void)testStartSpanFastPathPerformance {
+    LSSpanContext *parent = ((LSSpan *)[self.tracer startSpan:@"parent"]).context;
+    [self _measureIterations:10000
+                        body:^(int i) {
+                            LSSpan *span = [self.tracer startSpan:@"op" parentContext:parent];
+                            // Boxed, but small integers are tagged pointers, so this costs no allocation.
+                            [span setTag:@"int" integerValue:i];
+                            [span setTag:@"bool" boolValue:true];
+                        }
+                  completion:nil];
+}
+
+- (void)testDisabledTracerHandsOutNonRecordingSpan {
+    self.tracer.enabled = false;
+    LSSpan *root = (LSSpan *)[self.tracer startSpan:@"root" tags:@{ @"key": @"value" }];
+    XCTAssertFalse(root.isRecording);
+    XCTAssertEqual([self.tracer startSpan:@"other"], root);
+    XCTAssertEqual([self.tracer startSpan:@"child" childOf:root.context], root);
+    [root setTag:@"key" value:@"value"];
+    [root setBaggageItem:@"suitcase" value:@"brown"];
+    [root log:@{ @"event": @"ignored" }];
+    XCTAssertEqual(root.tags.count, 0);
+    XCTAssertNil([root getBaggageItem:@"suitcase"]);
+    XCTAssertEqual(root.tracer, self.tracer);
+
+    // Re-enabling takes effect for new spans, but children of non-recording spans stay non-recording.
+    self.tracer.enabled = true;
+    XCTAssertTrue(((LSSpan *)[self.tracer startSpan:@"root"]).isRecording);
+    XCTAssertEqual([self.tracer startSpan:@"child" childOf:root.context], root);
+}
+
+- (void)testApplyConfiguration {
+    [self.tracer applyConfiguration:@{
+        @"enabled": @(false),
+        @"max_span_records": @(10),
+        @"max_payload_json_length": @(100),
+        @"flush_interval_seconds": @(5),
+        @"sample_rate": @(2),
+        @"unknown": @"ignored"
+    }];
+    XCTAssertFalse(self.tracer.enabled);
+    XCTAssertEqual(self.tracer.maxSpanRecords, 10);
+    XCTAssertEqual(self.tracer.maxPayloadJSONLength, 100);
+    XCTAssertEqual(self.tracer.flushIntervalSeconds, 5);
+    XCTAssertEqual(self.tracer.sampleRate, 1.0);
+
+    [self.tracer applyConfiguration:@{ @"enabled": @(true), @"sample_rate": @(0), @"flush_interval_seconds": @(0) }];
+    XCTAssertEqual(self.tracer.flushIntervalSeconds, 0);
+    LSSpan *unsampled = (LSSpan *)[self.tracer startSpan:@"root"];
+    XCTAssertFalse(unsampled.isRecording);
+    NSMutableDictionary *carrier = [NSMutableDictionary dictionary];
+    XCTAssertTrue([self.tracer inject:unsampled.context format:OTFormatTextMap carrier:carrier]);
+    XCTAssertEqual(carrier.count, 0);
+
+    // Unsupported formats are still reported as such.
+    NSError *error;
+    XCTAssertFalse([self.tracer inject:unsampled.context format:OTFormatBinary carrier:carrier error:&error]);
+    XCTAssertEqual(error.code, OTUnsupportedFormatCode);
+}
+
+- (void)testReapplyingConfigurationKeepsFlushTimer {
+    NSString *path = [NSString stringWithFormat:@"/tmp/lightstep-test-%d.sock", getpid()];
+    LSTestAgent *agent = [[LSTestAgent alloc] initWithUnixSocketPath:path];
+    LSTracer *tracer = [[LSTracer alloc] initWithToken:@"TEST_TOKEN"
+                                         componentName:@"LightStepUnitTests"
+                                               baseURL:nil
+                                  flushIntervalSeconds:1];
+    tracer.transport = [[LSUnixSocketTransport alloc] initWithPath:path];
+    [[tracer startSpan:@"span"] finish];
+
+    // A configuration poll that runs more often than the flush interval must not keep postponing the flush.
+    for (int i = 0; i < 10; i++) {
+        [tracer applyConfiguration:@{ @"flush_interval_seconds": @(1) }];
+        [NSThread sleepForTimeInterval:0.3];
+    }
+    XCTAssertTrue([agent waitForSpanCount:1 timeout:1]);
+    [tracer shutdownWithTimeout:1];
+    [agent stop];
+}
+
+- (void)testNonRecordingSpanPerformance {
+    self.tracer.enabled = false;
+    [self _measureIterations:10000
+                        body:^(int i) {
+                            id<OTSpan> span = [self.tracer startSpan:@"op"];
+                            [span setTag:@"key" value:@"value"];
+                            [span log:@{ @"event": @"ignored" }];
+                            [span finish];
+                        }
+                  completion:nil];
+}
+
+- (void)testTracerConstructionPerformance {
+    [self measureBlock:^{
+        for (int i = 0; i < 100; i++) {
+            (void)[[LSTracer alloc] initWithToken:@"TEST_TOKEN"
+                                    componentName:@"LightStepUnitTests"
+                                          baseURL:[NSURL URLWithString:@"http://localhost:9997"]
+                             flushIntervalSeconds:30];
+        }
+    }];
+}
+
+- (void)testTimeToFirstSpanPerformance {
+    [self measureBlock:^{
+        for (int i = 0; i < 100; i++) {
+            LSTracer *tracer = [[LSTracer alloc] initWithToken:@"TEST_TOKEN"
+                                                 componentName:@"LightStepUnitTests"
+                                                       baseURL:[NSURL URLWithString:@"http://localhost:9997"]
+                                          flushIntervalSeconds:30];
+            [[tracer startSpan:@"first"] finish];
+        }
+    }];
+}
+
+- (void)testFlushAlwaysCallsBack {
+    XCTestExpectation *empty = [self expectationWithDescription:@"empty flush"];
+    [self.tracer flush:^(NSError *_Nullable error) {
+        XCTAssertNil(error);
+        [empty fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testShutdownHonorsDeadline {
+    // Nothing listens on the test collector URL, so none of these spans can be acknowledged.
+    for (int i = 0; i < 10; i++) {
+        [[self.tracer startSpan:@"span"] finish];
+    }
+    NSDate *start = [NSDate date];
+    XCTAssertEqual([self.tracer shutdownWithTimeout:2], 0);
+    XCTAssertLessThan([[NSDate date] timeIntervalSinceDate:start], 3);
+    XCTAssertFalse(self.tracer.enabled);
+
+    // Shutting down again is harmless.
+    XCTAssertEqual([self.tracer shutdownWithTimeout:0], 0);
+}
+
+- (void)testShutdownStopsAcceptingSpans {
+    id<OTSpan> late = [self.tracer startSpan:@"late"];
+    [self.tracer shutdownWithTimeout:0];
+    [late finish];
+    XCTAssertEqual(self.tracer.bufferedBytes, 0);
+
+    // Configuration cannot revive a shut-down tracer.
+    [self.tracer applyConfiguration:@{ @"enabled": @(true) }];
+    XCTAssertFalse(self.tracer.enabled);
+    self.tracer.enabled = true;
+    XCTAssertFalse(self.tracer.enabled);
+}
+
+- (void)testActiveSpan {
+    XCTAssertNil(self.tracer.activeSpan);
+    LSSpan *outer = (LSSpan *)[self.tracer startSpan:@"outer"];
+    LSScope *outerScope = [self.tracer activateSpan:outer];
+    XCTAssertEqual(self.tracer.activeSpan, outer);
+
+    // Spans started without a parent become children of the active span, whichever overload is used.
+    LSSpan *implicit = (LSSpan *)[self.tracer startSpan:@"implicit"];
+    LSSpan *fast = [self.tracer startSpan:@"fast" parentContext:nil];
+    XCTAssertEqual(implicit.context.traceId, outer.context.traceId);
+    XCTAssertEqual(fast.context.traceId, outer.context.traceId);
+
+    // Unless a new trace is asked for explicitly.
+    LSSpan *explicitRoot = [self.tracer startRootSpan:@"job"];
+    XCTAssertNotEqual(explicitRoot.context.traceId, outer.context.traceId);
+    XCTAssertFalse([[explicitRoot _toJSONWithFinishTime:[NSDate date]][@"attributes"]
+        containsObject:@{ @"Key": @"parent_span_guid", @"Value": outer.context.hexSpanId }]);
+
+    LSScope *innerScope = [self.tracer activateSpan:implicit];
+    XCTAssertEqual(self.tracer.activeSpan, implicit);
+    [innerScope close];
+    [innerScope close];
+    XCTAssertEqual(self.tracer.activeSpan, outer);
+    [outerScope close];
+    XCTAssertNil(self.tracer.activeSpan);
+
+    LSSpan *root = (LSSpan *)[self.tracer startSpan:@"root"];
+    XCTAssertNotEqual(root.context.traceId, outer.context.traceId);
+}
+
+- (void)testActiveSpanCrossesDispatch {
+    dispatch_queue_t queue = dispatch_queue_create("com.lightstep.tests.active", DISPATCH_QUEUE_SERIAL);
+    dispatch_group_t group = dispatch_group_create();
+    LSSpan *span = (LSSpan *)[self.tracer startSpan:@"span"];
+    LSScope *scope = [self.tracer activateSpan:span];
+
+    XCTestExpectation *async = [self expectationWithDescription:@"LSDispatchAsync"];
+    XCTestExpectation *after = [self expectationWithDescription:@"LSDispatchAfter"];
+    XCTestExpectation *grouped = [self expectationWithDescription:@"LSDispatchGroupAsync"];
+    LSDispatchAsync(queue, ^{
+        XCTAssertEqual(LSActiveSpan(), span);
+        [async fulfill];
+    });
+    LSDispatchAfter(dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_MSEC), queue, ^{
+        XCTAssertEqual(LSActiveSpan(), span);
+        [after fulfill];
+    });
+    LSDispatchGroupAsync(group, queue, ^{
+        XCTAssertEqual(LSActiveSpan(), span);
+        [grouped fulfill];
+    });
+    [scope close];
+
+    // The queue's thread is left as it was found, and nothing is propagated once the scope is closed.
+    XCTestExpectation *cleared = [self expectationWithDescription:@"cleared"];
+    LSDispatchAsync(queue, ^{
+        XCTAssertNil(LSActiveSpan());
+        [cleared fulfill];
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    // Having no active span propagates too: the block does not inherit a span left active on the target thread.
+    LSScope *mainScope = [self.tracer activateSpan:(LSSpan *)[self.tracer startSpan:@"main"]];
+    XCTestExpectation *isolated = [self expectationWithDescription:@"isolated"];
+    dispatch_async(queue, ^{
+        LSDispatchAsync(dispatch_get_main_queue(), ^{
+            XCTAssertNil(LSActiveSpan());
+            [isolated fulfill];
+        });
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(LSActiveSpan(), mainScope.span);
+    [mainScope close];
+}
+
+- (void)testDispatchAsyncPerformance {
+    dispatch_queue_t queue = dispatch_queue_create("com.lightstep.tests.bench", DISPATCH_QUEUE_SERIAL);
+    LSScope *scope = [self.tracer activateSpan:(LSSpan *)[self.tracer startSpan:@"span"]];
+    [self _measureIterations:10000
+                        body:^(int i) {
+                            dispatch_async(queue, ^{
+                            });
+                        }
+                  completion:^{
+                      dispatch_sync(queue, ^{
+                      });
+                  }];
+    [scope close];
+}
+
+- (void)testLSDispatchAsyncPerformance {
+    dispatch_queue_t queue = dispatch_queue_create("com.lightstep.tests.bench", DISPATCH_QUEUE_SERIAL);
+    LSScope *scope = [self.tracer activateSpan:(LSSpan *)[self.tracer startSpan:@"span"]];
+    [self _measureIterations:10000
+                        body:^(int i) {
+                            LSDispatchAsync(queue, ^{
+                            });
+                        }
+                  completion:^{
+                      dispatch_sync(queue, ^{
+                      });
+                  }];
+    [scope close];
+}
+
+- (void)testSpanBufferKeepsRootAndErrorSpans {
+    self.tracer.maxSpanRecords = 2;
+    NSDate *now = [NSDate date];
+    LSSpan *root = [self.tracer startSpan:@"root" parentContext:nil];
+    LSSpan *error = [self.tracer startSpan:@"error" parentContext:root.context];
+    [error setTag:@"error" boolValue:true];
+    NSDictionary *rootJSON = [root _toJSONWithFinishTime:now];
+    NSDictionary *errorJSON = [error _toJSONWithFinishTime:now];
+    NSUInteger rootBytes = [LSUtil estimatedJSONLengthOfObject:rootJSON];
+    NSUInteger errorBytes = [LSUtil estimatedJSONLengthOfObject:errorJSON];
+
+    // Ordinary children make way for each other, oldest first, and then for the error span.
+    [self.tracer _appendSpanJSON:rootJSON];
+    for (int i = 0; i < 10; i++) {
+        LSSpan *child = [self.tracer startSpan:@"child" parentContext:root.context];
+        [self.tracer _appendSpanJSON:[child _toJSONWithFinishTime:now]];
+    }
+    [self.tracer _appendSpanJSON:errorJSON];
+    XCTAssertEqual(self.tracer.droppedSpanCount, 10);
+    XCTAssertEqual(self.tracer.bufferedBytes, rootBytes + errorBytes);
+
+    // With only high-priority spans left, a new ordinary span is the one dropped.
+    self.tracer.maxSpanRecords = 100;
+    self.tracer.maxBufferedBytes = rootBytes + errorBytes;
+    LSSpan *child = [self.tracer startSpan:@"child" parentContext:root.context];
+    [self.tracer _appendSpanJSON:[child _toJSONWithFinishTime:now]];
+    XCTAssertEqual(self.tracer.droppedSpanCount, 11);
+    XCTAssertEqual(self.tracer.bufferedBytes, rootBytes + errorBytes);
+
+    // A span that could never fit does not evict anything.
+    LSSpan *huge = [self.tracer startSpan:@"huge" parentContext:nil];
+    [huge setTag:@"blob" value:[@"" stringByPaddingToLength:rootBytes + errorBytes withString:@"x" startingAtIndex:0]];
+    [self.tracer _appendSpanJSON:[huge _toJSONWithFinishTime:now]];
+    XCTAssertEqual(self.tracer.droppedSpanCount, 12);
+    XCTAssertEqual(self.tracer.bufferedBytes, rootBytes + errorBytes);
+
+    // Tag keys need not be strings.
+    LSSpan *numberKeyed = [self.tracer startSpan:@"number_keyed" parentContext:root.context];
+    [numberKeyed addTags:(NSDictionary *)@{ @1: @"x" }];
+    NSDictionary *numberKeyedJSON = [numberKeyed _toJSONWithFinishTime:now];
+    XCTAssertFalse([LSUtil spanJSONHasErrorTag:numberKeyedJSON]);
+    XCTAssertFalse([LSUtil spanJSONIsRoot:numberKeyedJSON]);
+
+    XCTestExpectation *flushed = [self expectationWithDescription:@"flushed"];
+    [self.tracer flush:^(NSError *_Nullable error) {
+        [flushed fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(self.tracer.bufferedBytes, 0);
+}
+
+- (void)testUnixSocketTransport {
+    NSString *path = [NSString stringWithFormat:@"/tmp/lightstep-test-%d.sock", getpid()];
+    LSTestAgent *agent = [[LSTestAgent alloc] initWithUnixSocketPath:path];
+    self.tracer.transport = [[LSUnixSocketTransport alloc] initWithPath:path];
+    for (int i = 0; i < 10; i++) {
+        [[self.tracer startSpan:@"span"] finish];
+    }
+    XCTAssertEqual([self.tracer drainWithTimeout:5], 10);
+    // Delivery means written in full, which can be a moment before the agent has read it.
+    XCTAssertTrue([agent waitForSpanCount:10 timeout:5]);
+    XCTAssertEqual(agent.reportCount, 1);
+    XCTAssertEqualObjects(agent.lastAccessToken, @"TEST_TOKEN");
+
+    // Clearing the transport restores the HTTP default rather than leaving reports with nowhere to go.
+    id<LSTransport> unixTransport = self.tracer.transport;
+    self.tracer.transport = nil;
+    XCTAssertTrue([self.tracer.transport isKindOfClass:[LSHTTPTransport class]]);
+    self.tracer.transport = unixTransport;
+
+    // A missing agent fails the report, and the next report reconnects.
+    [agent stop];
+    [[self.tracer startSpan:@"span"] finish];
+    XCTAssertEqual([self.tracer drainWithTimeout:5], 0);
+    agent = [[LSTestAgent alloc] initWithUnixSocketPath:path];
+    [[self.tracer startSpan:@"span"] finish];
+    XCTAssertEqual([self.tracer drainWithTimeout:5], 1);
+    XCTAssertTrue([agent waitForSpanCount:1 timeout:5]);
+    [agent stop];
+}
+
+// Delivers 100 reports of 100 spans each to `agent` per run.
+- (void)_measureReportThroughputWithTransport:(nullable id<LSTransport>)transport agent:(LSTestAgent *)agent {
+    LSTracer *tracer = [[LSTracer alloc] initWithToken:@"TEST_TOKEN"
+                                         componentName:@"LightStepUnitTests"
+                                               baseURL:agent.url
+                                  flushIntervalSeconds:0];
+    if (transport != nil) {
+        tracer.transport = transport;
+    }
+    [self _measureIterations:100
+                        body:^(int i) {
+                            for (int j = 0; j < 100; j++) {
+                                [[tracer startSpan:@"span"] finish];
+                            }
+                            [tracer drainWithTimeout:5];
+                        }
+                  completion:nil];
+    XCTAssertTrue([agent waitForSpanCount:tracer.reportedSpanCount timeout:5]);
+    [agent stop];
+}
+
+- (void)testHTTPTransportThroughputPerformance {
+    [self _measureReportThroughputWithTransport:nil agent:[[LSTestAgent alloc] initHTTP]];
+}
+
+- (void)testUnixSocketTransportThroughputPerformance {
+    NSString *path = [NSString stringWithFormat:@"/tmp/lightstep-bench-%d.sock", getpid()];
+    [self _measureReportThroughputWithTransport:[[LSUnixSocketTransport alloc] initWithPath:path]
+                                          agent:[[LSTestAgent alloc] initWithUnixSocketPath:path]];
+}
+
 - (void)assertLogKV:(NSDictionary *)logStruct key:(NSString *)key value:(NSString *_Nullable)value {
     for (NSDictionary *keyValuePair in logStruct[@"fields"]) {
         if ([keyValuePair[@"Key"] isEqualToString:key]) {
@@ -182,6 +891,186 @@ const NSUInteger kMaxLength = 8192;
     XCTAssert([[child2 getBaggageItem:@"backpack"] isEqualToString:@"gray"]);
 }
 
+- (void)testStringInterner {
+    // NOTE: strings are built at runtime and kept longer than a tagged pointer can hold, so that identity
+    // comparisons below are meaningful.
+    LSStringInterner *interner = [[LSStringInterner alloc] initWithMaxStrings:2 maxStringLength:32];
+    NSString *tooLong = [@"" stringByPaddingToLength:33 withString:@"x" startingAtIndex:0];
+    XCTAssertEqual([interner intern:tooLong], tooLong);
+    XCTAssertEqual(interner.count, 0);
+
+    NSString *method = [interner intern:[NSMutableString stringWithString:@"http.method.value"]];
+    XCTAssertEqual([interner intern:[@"http.method" stringByAppendingString:@".value"]], method);
+    XCTAssertEqual(interner.count, 1);
+    [interner intern:[@"http.status" stringByAppendingString:@".value"]];
+    NSString *overflow = [@"http.url" stringByAppendingString:@".value"];
+    XCTAssertEqual([interner intern:overflow], overflow); // the table is full
+    XCTAssertEqual(interner.count, 2);
+
+    // Spans from the same tracer share operation names and tag keys.
+    NSString *op = [@"interned" stringByAppendingString:@".operation"];
+    NSDictionary *tags = @{ [@"interned" stringByAppendingString:@".tag.key"]: @(1234567890123456) };
+    NSDate *now = [NSDate date];
+    NSDictionary *json1 = [(LSSpan *)[self.tracer startSpan:op.mutableCopy tags:tags] _toJSONWithFinishTime:now];
+    NSDictionary *json2 = [(LSSpan *)[self.tracer startSpan:op.mutableCopy tags:tags] _toJSONWithFinishTime:now];
+    XCTAssertEqual(json1[@"span_name"], json2[@"span_name"]);
+    XCTAssertEqual(json1[@"attributes"][0][@"Key"], json2[@"attributes"][0][@"Key"]);
+
+    // Tag dictionaries are untyped at runtime; anything that is not a string is passed through as-is.
+    XCTAssertEqualObjects([interner intern:(NSString *)@1], @1);
+    XCTAssertEqualObjects([interner internValue:(NSString *)@1], @1);
+    LSSpan *numberKeyed = (LSSpan *)[self.tracer startSpan:@"number_keyed" tags:(NSDictionary *)@{ @1: @"x" }];
+    XCTAssertEqualObjects([numberKeyed _toJSONWithFinishTime:now][@"attributes"][0][@"Key"], @1);
+}
+
+- (void)testStringInternerAdmitsRepeatedValues {
+    LSStringInterner *interner = [[LSStringInterner alloc] initWithMaxStrings:4 maxStringLength:32];
+
+    // A value is only interned the second time it is seen.
+    NSString *first = [@"GET" stringByAppendingString:@" /checkout/cart"];
+    XCTAssertEqual([interner internValue:first], first);
+    XCTAssertEqual(interner.count, 0);
+    NSString *second = [@"GET" stringByAppendingString:@" /checkout/cart"];
+    NSString *canonical = [interner internValue:second];
+    XCTAssertEqual(interner.count, 1);
+    XCTAssertEqual([interner internValue:[@"GET" stringByAppendingString:@" /checkout/cart"]], canonical);
+
+    // Values take at most half of the table, leaving room for names and keys.
+    for (int i = 0; i < 3; i++) {
+        NSString *value = [NSString stringWithFormat:@"repeated.value.%d", i];
+        [interner internValue:value];
+        [interner internValue:value];
+    }
+    XCTAssertEqual(interner.count, 2);
+    [interner intern:[@"operation" stringByAppendingString:@".name.one"]];
+    [interner intern:[@"operation" stringByAppendingString:@".name.two"]];
+    XCTAssertEqual(interner.count, 4);
+
+    // One-off values set as tags leave the tracer's table untouched.
+    NSUInteger countBefore = self.tracer.stringInterner.count;
+    for (int i = 0; i < 100; i++) {
+        LSSpan *span = [self.tracer startSpan:@"span" parentContext:nil];
+        [span setTag:@"request.id" value:[NSString stringWithFormat:@"request-%d", i]];
+        [span _toJSONWithFinishTime:[NSDate date]];
+    }
+    XCTAssertLessThanOrEqual(self.tracer.stringInterner.count, countBefore + 2); // the operation name and key
+}
+
+- (void)testTraceAssemblerRetention {
+    LSTraceAssembler *assembler = [[LSTraceAssembler alloc] initWithMaxBufferedSpans:100 maxTraceAgeSeconds:60];
+    assembler.retainedOperationNames = [NSSet setWithObject:@"interesting"];
+    self.tracer.traceAssembler = assembler;
+
+    // A fast, error-free trace is discarded once its local root finishes.
+    LSSpan *boringRoot = (LSSpan *)[self.tracer startSpan:@"boring"];
+    LSSpan *boringChild = (LSSpan *)[self.tracer startSpan:@"boring_child" childOf:boringRoot.context];
+    NSDate *now = [NSDate date];
+    XCTAssertEqual([assembler addSpanJSON:[boringChild _toJSONWithFinishTime:now]].count, 0);
+    XCTAssertEqual(assembler.bufferedSpanCount, 1);
+    XCTAssertEqual([assembler addSpanJSON:[boringRoot _toJSONWithFinishTime:now]].count, 0);
+    XCTAssertEqual(assembler.bufferedSpanCount, 0);
+    XCTAssertEqual(assembler.discardedTraceCount, 1);
+
+    // An error anywhere in the trace retains all of its spans.
+    LSSpan *errorRoot = (LSSpan *)[self.tracer startSpan:@"root"];
+    LSSpan *errorChild =
+        (LSSpan *)[self.tracer startSpan:@"child" childOf:errorRoot.context tags:@{ @"error": @(true) }];
+    XCTAssertEqual([assembler addSpanJSON:[errorChild _toJSONWithFinishTime:now]].count, 0);
+    XCTAssertEqual([assembler addSpanJSON:[errorRoot _toJSONWithFinishTime:now]].count, 2);
+    XCTAssertEqual(assembler.retainedTraceCount, 1);
+
+    // So does a matching operation name.
+    LSSpan *interesting = (LSSpan *)[self.tracer startSpan:@"interesting"];
+    XCTAssertEqual([assembler addSpanJSON:[interesting _toJSONWithFinishTime:now]].count, 1);
+
+    // And a trace that exceeds the duration threshold.
+    assembler.durationThresholdMicros = 1000;
+    LSSpan *slow = (LSSpan *)[self.tracer startSpan:@"slow"
+                                            childOf:nil
+                                               tags:nil
+                                          startTime:[NSDate dateWithTimeIntervalSinceNow:-1]];
+    XCTAssertEqual([assembler addSpanJSON:[slow _toJSONWithFinishTime:now]].count, 1);
+    XCTAssertEqual(assembler.retainedTraceCount, 3);
+    XCTAssertEqual(assembler.discardedTraceCount, 1);
+}
+
+- (void)testTraceAssemblerEviction {
+    LSTraceAssembler *assembler = [[LSTraceAssembler alloc] initWithMaxBufferedSpans:2 maxTraceAgeSeconds:0];
+    self.tracer.traceAssembler = assembler;
+
+    // The root never finishes, so the trace is only released by eviction.
+    LSSpan *root = (LSSpan *)[self.tracer startSpan:@"root"];
+    LSSpan *child = (LSSpan *)[self.tracer startSpan:@"child" childOf:root.context tags:@{ @"error": @"true" }];
+    NSArray *retained = [assembler addSpanJSON:[child _toJSONWithFinishTime:[NSDate date]]];
+    XCTAssertEqual(retained.count, 1);
+    XCTAssertEqual(assembler.bufferedSpanCount, 0);
+    XCTAssertEqual(assembler.retainedTraceCount, 1);
+
+    // Traces whose spans have all yet to finish are capped as well.
+    for (int i = 0; i < 10; i++) {
+        [self.tracer startSpan:@"unfinished"];
+    }
+    XCTAssertEqual(assembler.pendingTraceCount, 2);
+    XCTAssertEqual(assembler.discardedTraceCount, 0);
+    [[self.tracer startSpan:@"done"] finish];
+    XCTAssertEqual(assembler.bufferedSpanCount, 0);
+}
+
+- (void)testTraceAssemblerRoutesLateSpans {
+    LSTraceAssembler *assembler = [[LSTraceAssembler alloc] initWithMaxBufferedSpans:100 maxTraceAgeSeconds:0];
+    self.tracer.traceAssembler = assembler;
+    NSDate *now = [NSDate date];
+
+    // The trace expires with its root still open; the root follows the retained verdict when it finally finishes.
+    LSSpan *root = (LSSpan *)[self.tracer startSpan:@"root"];
+    LSSpan *child = (LSSpan *)[self.tracer startSpan:@"child" childOf:root.context tags:@{ @"error": @(true) }];
+    XCTAssertEqual([assembler addSpanJSON:[child _toJSONWithFinishTime:now]].count, 1);
+    LSSpan *lateChild = (LSSpan *)[self.tracer startSpan:@"late_child" childOf:root.context];
+    XCTAssertEqual(assembler.pendingTraceCount, 0);
+    XCTAssertEqual([assembler addSpanJSON:[lateChild _toJSONWithFinishTime:now]].count, 1);
+    XCTAssertEqual([assembler addSpanJSON:[root _toJSONWithFinishTime:now]].count, 1);
+    XCTAssertEqual(assembler.retainedTraceCount, 1);
+
+    // Likewise for a discarded trace, whose late root is dropped.
+    LSSpan *boringRoot = (LSSpan *)[self.tracer startSpan:@"boring"];
+    LSSpan *boringChild = (LSSpan *)[self.tracer startSpan:@"boring_child" childOf:boringRoot.context];
+    XCTAssertEqual([assembler addSpanJSON:[boringChild _toJSONWithFinishTime:now]].count, 0);
+    XCTAssertEqual([assembler addSpanJSON:[boringRoot _toJSONWithFinishTime:now]].count, 0);
+    XCTAssertEqual(assembler.discardedTraceCount, 1);
+    XCTAssertEqual(assembler.retainedTraceCount, 1);
+    XCTAssertEqual(assembler.pendingTraceCount, 0);
+    XCTAssertEqual(assembler.bufferedSpanCount, 0);
+}
+
+- (void)testTraceAssemblerReportsRetainedTraces {
+    NSString *path = [NSString stringWithFormat:@"/tmp/lightstep-test-%d.sock", getpid()];
+    LSTestAgent *agent = [[LSTestAgent alloc] initWithUnixSocketPath:path];
+    self.tracer.transport = [[LSUnixSocketTransport alloc] initWithPath:path];
+    LSTraceAssembler *assembler = [[LSTraceAssembler alloc] initWithMaxBufferedSpans:100 maxTraceAgeSeconds:0.2];
+    assembler.retainedOperationNames = [NSSet setWithObject:@"interesting"];
+    self.tracer.traceAssembler = assembler;
+
+    id<OTSpan> boring = [self.tracer startSpan:@"boring"];
+    [[self.tracer startSpan:@"boring_child" childOf:boring.context] finish];
+    [boring finish];
+    id<OTSpan> interesting = [self.tracer startSpan:@"interesting"];
+    [[self.tracer startSpan:@"interesting_child" childOf:interesting.context] finish];
+    [interesting finish];
+
+    // This trace's root never finishes; its error child is reported once the trace expires and a flush evicts it.
+    id<OTSpan> unfinished = [self.tracer startSpan:@"unfinished"];
+    [[self.tracer startSpan:@"failed" childOf:unfinished.context tags:@{ @"error": @(true) }] finish];
+    XCTAssertEqual(assembler.bufferedSpanCount, 1);
+    [NSThread sleepForTimeInterval:0.3];
+
+    XCTAssertEqual([self.tracer drainWithTimeout:5], 3);
+    XCTAssertTrue([agent waitForSpanCount:3 timeout:5]);
+    XCTAssertEqualObjects([NSSet setWithArray:agent.operationNames],
+                          ([NSSet setWithObjects:@"interesting", @"interesting_child", @"failed", nil]));
+    XCTAssertEqual(assembler.bufferedSpanCount, 0);
+    [agent stop];
+}
+
 @end
 
 NS_ASSUME_NONNULL_END